@@ -10,11 +10,729 @@
 #include <iostream>
 #include <functional>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <type_traits>
+#include <new>
+#include <memory>
+#include <string>
+#include <cassert>
+#include <unordered_map>
+#include <cctype>
 
 #ifdef __linux__
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
 #endif
 
+// --------------------
+// --- SIMD KERNELS ---
+// --------------------
+#pragma region SIMD KERNELS
+// Pixel loops, written once per instruction set and picked at startup by 
+// what the CPU supports. The scalar versions are the reference the others
+// are verified against, see VerifyKernels()
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define RPE_KERNELS_X86
+#include <immintrin.h>
+#define RPE_TARGET(isa) __attribute__((target(isa)))
+#elif defined(__ARM_NEON)
+#define RPE_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace rpe {
+namespace kernels {
+    /// Instruction set a kernel table is written for
+    enum class SimdLevel : uint8_t {
+        SCALAR = 0,
+        SSE2 = 1,
+        AVX2 = 2,
+        AVX512 = 3,
+        NEON = 4,
+    };
+
+    /// Fills bigger than this (in bytes) bypass the cache, they would
+    /// only evict everything else
+    constexpr size_t streamThreshold = 16u << 20;
+
+    /// Every kernel of one instruction set
+    struct KernelTable {
+        SimdLevel level;
+        const char* name;
+        /// Set `count` pixels starting at `dst` to `color`
+        void (*Fill32)(uint32_t* dst, size_t count, uint32_t color);
+        /// Copy `count` pixels, except the ones equal to `key`
+        void (*ColorKey32)(uint32_t* dst, const uint32_t* src, size_t count, uint32_t key);
+        /// Premultiplied alpha "over", dst = src + dst * (255 - src.a) / 255
+        void (*Blend32)(uint32_t* dst, const uint32_t* src, size_t count);
+        /// Copy `count` palette indices, except the ones equal to `key`
+        void (*ColorKey8)(uint8_t* dst, const uint8_t* src, size_t count, uint8_t key);
+        /// Look `count` palette indices up in a 256 entry palette
+        void (*Expand8)(uint32_t* dst, const uint8_t* src, size_t count, 
+            const uint32_t* palette);
+        /// Repeat each of `count` pixels `factor` times, nearest neighbour 
+        /// horizontal upscale. Writes count * factor pixels
+        void (*Upscale32)(uint32_t* dst, const uint32_t* src, size_t count, 
+            unsigned int factor);
+    };
+
+    // --- Scalar reference ---
+
+    inline void Fill32Scalar(uint32_t* dst, size_t count, uint32_t color) {
+        for (size_t i = 0; i < count; i++) dst[i] = color;
+    }
+
+    inline void ColorKey32Scalar(uint32_t* dst, const uint32_t* src, size_t count, 
+        uint32_t key) {
+        for (size_t i = 0; i < count; i++) {
+            if (src[i] != key) dst[i] = src[i];
+        }
+    }
+
+    /// x / 255 rounded, exact for x in 0..255*255, the vector kernels use
+    /// the very same formula
+    constexpr uint32_t Div255(uint32_t x) {
+        return (x + 128 + ((x + 128) >> 8)) >> 8;
+    }
+
+    inline void ColorKey8Scalar(uint8_t* dst, const uint8_t* src, size_t count, 
+        uint8_t key) {
+        for (size_t i = 0; i < count; i++) {
+            if (src[i] != key) dst[i] = src[i];
+        }
+    }
+
+    inline void Expand8Scalar(uint32_t* dst, const uint8_t* src, size_t count, 
+        const uint32_t* palette) {
+        for (size_t i = 0; i < count; i++) dst[i] = palette[src[i]];
+    }
+
+    inline void Upscale32Scalar(uint32_t* dst, const uint32_t* src, size_t count, 
+        unsigned int factor) {
+        for (size_t i = 0; i < count; i++) {
+            for (unsigned int j = 0; j < factor; j++) *dst++ = src[i];
+        }
+    }
+
+    inline void Blend32Scalar(uint32_t* dst, const uint32_t* src, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            uint32_t s = src[i], d = dst[i], inv = 255 - (s >> 24), out = 0;
+
+            for (int shift = 0; shift < 32; shift += 8) {
+                uint32_t c = ((s >> shift) & 0xff) + Div255(((d >> shift) & 0xff) * inv);
+                out |= std::min<uint32_t>(c, 255) << shift;
+            }
+            dst[i] = out;
+        }
+    }
+
+#ifdef RPE_KERNELS_X86
+    // --- SSE2 ---
+
+    RPE_TARGET("sse2")
+    inline void Fill32Sse2(uint32_t* dst, size_t count, uint32_t color) {
+        // Scalar head up to the first aligned vector
+        while (count > 0 && (uintptr_t(dst) & 15)) *dst++ = color, count--;
+
+        __m128i v = _mm_set1_epi32(int(color));
+        bool stream = count * 4 >= streamThreshold;
+        
+        if (stream) {
+            for (; count >= 16; count -= 16, dst += 16) {
+                _mm_stream_si128((__m128i*)dst, v);
+                _mm_stream_si128((__m128i*)dst + 1, v);
+                _mm_stream_si128((__m128i*)dst + 2, v);
+                _mm_stream_si128((__m128i*)dst + 3, v);
+            }
+            _mm_sfence();
+        } else {
+            for (; count >= 16; count -= 16, dst += 16) {
+                _mm_store_si128((__m128i*)dst, v);
+                _mm_store_si128((__m128i*)dst + 1, v);
+                _mm_store_si128((__m128i*)dst + 2, v);
+                _mm_store_si128((__m128i*)dst + 3, v);
+            }
+        }
+
+        for (; count >= 4; count -= 4, dst += 4) _mm_store_si128((__m128i*)dst, v);
+        while (count--) *dst++ = color;
+    }
+
+    RPE_TARGET("sse2")
+    inline void ColorKey32Sse2(uint32_t* dst, const uint32_t* src, size_t count, 
+        uint32_t key) {
+        __m128i k = _mm_set1_epi32(int(key));
+
+        for (; count >= 4; count -= 4, dst += 4, src += 4) {
+            __m128i s = _mm_loadu_si128((const __m128i*)src);
+            __m128i d = _mm_loadu_si128((const __m128i*)dst);
+            __m128i keep = _mm_cmpeq_epi32(s, k);
+            _mm_storeu_si128((__m128i*)dst, 
+                _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, s)));
+        }
+        ColorKey32Scalar(dst, src, count, key);
+    }
+
+    RPE_TARGET("sse2")
+    inline void ColorKey8Sse2(uint8_t* dst, const uint8_t* src, size_t count, 
+        uint8_t key) {
+        __m128i k = _mm_set1_epi8(char(key));
+
+        for (; count >= 16; count -= 16, dst += 16, src += 16) {
+            __m128i s = _mm_loadu_si128((const __m128i*)src);
+            __m128i d = _mm_loadu_si128((const __m128i*)dst);
+            __m128i keep = _mm_cmpeq_epi8(s, k);
+            _mm_storeu_si128((__m128i*)dst, 
+                _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, s)));
+        }
+        ColorKey8Scalar(dst, src, count, key);
+    }
+
+    /// No gathers before AVX2, the lookups are just unrolled
+    RPE_TARGET("sse2")
+    inline void Expand8Sse2(uint32_t* dst, const uint8_t* src, size_t count, 
+        const uint32_t* palette) {
+        for (; count >= 4; count -= 4, dst += 4, src += 4) {
+            _mm_storeu_si128((__m128i*)dst, _mm_setr_epi32(
+                int(palette[src[0]]), int(palette[src[1]]), 
+                int(palette[src[2]]), int(palette[src[3]])));
+        }
+        Expand8Scalar(dst, src, count, palette);
+    }
+
+    RPE_TARGET("sse2")
+    inline void Upscale32Sse2(uint32_t* dst, const uint32_t* src, size_t count, 
+        unsigned int factor) {
+        if (factor == 2) {
+            for (; count >= 4; count -= 4, dst += 8, src += 4) {
+                __m128i s = _mm_loadu_si128((const __m128i*)src);
+                _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi32(s, s));
+                _mm_storeu_si128((__m128i*)(dst + 4), _mm_unpackhi_epi32(s, s));
+            }
+        } else if (factor % 4 == 0) {
+            for (; count > 0; count--, src++) {
+                __m128i s = _mm_set1_epi32(int(*src));
+                for (unsigned int j = 0; j < factor; j += 4, dst += 4) {
+                    _mm_storeu_si128((__m128i*)dst, s);
+                }
+            }
+        }
+        Upscale32Scalar(dst, src, count, factor);
+    }
+
+    /// 16-bit lanes of `d` times `inv`, divided by 255 (see Div255)
+    RPE_TARGET("sse2")
+    inline __m128i MulDiv255Sse2(__m128i d, __m128i inv) {
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, inv), _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+    }
+
+    RPE_TARGET("sse2")
+    inline void Blend32Sse2(uint32_t* dst, const uint32_t* src, size_t count) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi16(255);
+        const __m128i alphaMask = _mm_set1_epi32(int(0xff000000));
+
+        for (; count >= 4; count -= 4, dst += 4, src += 4) {
+            __m128i s = _mm_loadu_si128((const __m128i*)src);
+            __m128i alpha = _mm_and_si128(s, alphaMask);
+
+            // Fully transparent or fully opaque, no math needed
+            int transparent = _mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero));
+            if (transparent == 0xffff) continue;
+            int opaque = _mm_movemask_epi8(_mm_cmpeq_epi32(alpha, alphaMask));
+            if (opaque == 0xffff) {
+                _mm_storeu_si128((__m128i*)dst, s);
+                continue;
+            }
+
+            __m128i d = _mm_loadu_si128((const __m128i*)dst);
+            __m128i sLo = _mm_unpacklo_epi8(s, zero), sHi = _mm_unpackhi_epi8(s, zero);
+            __m128i dLo = _mm_unpacklo_epi8(d, zero), dHi = _mm_unpackhi_epi8(d, zero);
+
+            // Alpha of each pixel into all four of its 16-bit lanes
+            __m128i aLo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sLo, 0xff), 0xff);
+            __m128i aHi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sHi, 0xff), 0xff);
+
+            dLo = MulDiv255Sse2(dLo, _mm_sub_epi16(ones, aLo));
+            dHi = MulDiv255Sse2(dHi, _mm_sub_epi16(ones, aHi));
+
+            _mm_storeu_si128((__m128i*)dst, 
+                _mm_adds_epu8(s, _mm_packus_epi16(dLo, dHi)));
+        }
+        Blend32Scalar(dst, src, count);
+    }
+
+    // --- AVX2 ---
+
+    RPE_TARGET("avx2")
+    inline void Fill32Avx2(uint32_t* dst, size_t count, uint32_t color) {
+        while (count > 0 && (uintptr_t(dst) & 31)) *dst++ = color, count--;
+
+        __m256i v = _mm256_set1_epi32(int(color));
+        bool stream = count * 4 >= streamThreshold;
+
+        if (stream) {
+            for (; count >= 32; count -= 32, dst += 32) {
+                _mm256_stream_si256((__m256i*)dst, v);
+                _mm256_stream_si256((__m256i*)dst + 1, v);
+                _mm256_stream_si256((__m256i*)dst + 2, v);
+                _mm256_stream_si256((__m256i*)dst + 3, v);
+            }
+            _mm_sfence();
+        } else {
+            for (; count >= 32; count -= 32, dst += 32) {
+                _mm256_store_si256((__m256i*)dst, v);
+                _mm256_store_si256((__m256i*)dst + 1, v);
+                _mm256_store_si256((__m256i*)dst + 2, v);
+                _mm256_store_si256((__m256i*)dst + 3, v);
+            }
+        }
+
+        for (; count >= 8; count -= 8, dst += 8) _mm256_store_si256((__m256i*)dst, v);
+        while (count--) *dst++ = color;
+    }
+
+    RPE_TARGET("avx2")
+    inline void ColorKey32Avx2(uint32_t* dst, const uint32_t* src, size_t count, 
+        uint32_t key) {
+        __m256i k = _mm256_set1_epi32(int(key));
+
+        for (; count >= 8; count -= 8, dst += 8, src += 8) {
+            __m256i s = _mm256_loadu_si256((const __m256i*)src);
+            __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+            _mm256_storeu_si256((__m256i*)dst, 
+                _mm256_blendv_epi8(s, d, _mm256_cmpeq_epi32(s, k)));
+        }
+        ColorKey32Sse2(dst, src, count, key);
+    }
+
+    RPE_TARGET("avx2")
+    inline void ColorKey8Avx2(uint8_t* dst, const uint8_t* src, size_t count, 
+        uint8_t key) {
+        __m256i k = _mm256_set1_epi8(char(key));
+
+        for (; count >= 32; count -= 32, dst += 32, src += 32) {
+            __m256i s = _mm256_loadu_si256((const __m256i*)src);
+            __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+            _mm256_storeu_si256((__m256i*)dst, 
+                _mm256_blendv_epi8(s, d, _mm256_cmpeq_epi8(s, k)));
+        }
+        ColorKey8Sse2(dst, src, count, key);
+    }
+
+    RPE_TARGET("avx2")
+    inline void Expand8Avx2(uint32_t* dst, const uint8_t* src, size_t count, 
+        const uint32_t* palette) {
+        for (; count >= 8; count -= 8, dst += 8, src += 8) {
+            __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)src));
+            _mm256_storeu_si256((__m256i*)dst, 
+                _mm256_i32gather_epi32((const int*)palette, index, 4));
+        }
+        Expand8Scalar(dst, src, count, palette);
+    }
+
+    /// 2x and 3x are permutes of 8 pixels, multiples of 8 whole 
+    /// broadcast stores, anything else goes to SSE2
+    RPE_TARGET("avx2")
+    inline void Upscale32Avx2(uint32_t* dst, const uint32_t* src, size_t count, 
+        unsigned int factor) {
+        if (factor == 2) {
+            const __m256i lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+            const __m256i hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+            for (; count >= 8; count -= 8, dst += 16, src += 8) {
+                __m256i s = _mm256_loadu_si256((const __m256i*)src);
+                _mm256_storeu_si256((__m256i*)dst, _mm256_permutevar8x32_epi32(s, lo));
+                _mm256_storeu_si256((__m256i*)(dst + 8), _mm256_permutevar8x32_epi32(s, hi));
+            }
+        } else if (factor == 3) {
+            const __m256i a = _mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2);
+            const __m256i b = _mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5);
+            const __m256i c = _mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7);
+            for (; count >= 8; count -= 8, dst += 24, src += 8) {
+                __m256i s = _mm256_loadu_si256((const __m256i*)src);
+                _mm256_storeu_si256((__m256i*)dst, _mm256_permutevar8x32_epi32(s, a));
+                _mm256_storeu_si256((__m256i*)(dst + 8), _mm256_permutevar8x32_epi32(s, b));
+                _mm256_storeu_si256((__m256i*)(dst + 16), _mm256_permutevar8x32_epi32(s, c));
+            }
+        } else if (factor == 4) {
+            const __m256i spread[4] = {
+                _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1),
+                _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3),
+                _mm256_setr_epi32(4, 4, 4, 4, 5, 5, 5, 5),
+                _mm256_setr_epi32(6, 6, 6, 6, 7, 7, 7, 7),
+            };
+            for (; count >= 8; count -= 8, dst += 32, src += 8) {
+                __m256i s = _mm256_loadu_si256((const __m256i*)src);
+                for (int i = 0; i < 4; i++) {
+                    _mm256_storeu_si256((__m256i*)(dst + i * 8),
+                        _mm256_permutevar8x32_epi32(s, spread[i]));
+                }
+            }
+        } else if (factor % 8 == 0) {
+            for (; count > 0; count--, src++) {
+                __m256i s = _mm256_set1_epi32(int(*src));
+                for (unsigned int j = 0; j < factor; j += 8, dst += 8) {
+                    _mm256_storeu_si256((__m256i*)dst, s);
+                }
+            }
+        }
+        Upscale32Sse2(dst, src, count, factor);
+    }
+
+    RPE_TARGET("avx2")
+    inline __m256i MulDiv255Avx2(__m256i d, __m256i inv) {
+        __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(d, inv), _mm256_set1_epi16(128));
+        return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+    }
+
+    RPE_TARGET("avx2")
+    inline void Blend32Avx2(uint32_t* dst, const uint32_t* src, size_t count) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i ones = _mm256_set1_epi16(255);
+        const __m256i alphaMask = _mm256_set1_epi32(int(0xff000000));
+        // Within each 128-bit lane, copies the alpha byte of every pixel 
+        // to the low byte of all its 16-bit lanes
+        const __m256i spread = _mm256_setr_epi8(
+            3, -1, 3, -1, 3, -1, 3, -1, 7, -1, 7, -1, 7, -1, 7, -1,
+            3, -1, 3, -1, 3, -1, 3, -1, 7, -1, 7, -1, 7, -1, 7, -1);
+
+        for (; count >= 8; count -= 8, dst += 8, src += 8) {
+            __m256i s = _mm256_loadu_si256((const __m256i*)src);
+            __m256i alpha = _mm256_and_si256(s, alphaMask);
+
+            if (_mm256_testz_si256(alpha, alpha)) continue;
+            if ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, alphaMask)) == 0xffffffffu) {
+                _mm256_storeu_si256((__m256i*)dst, s);
+                continue;
+            }
+
+            __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+            __m256i dLo = _mm256_unpacklo_epi8(d, zero), dHi = _mm256_unpackhi_epi8(d, zero);
+            __m256i aLo = _mm256_shuffle_epi8(s, spread);
+            __m256i aHi = _mm256_shuffle_epi8(_mm256_srli_si256(s, 8), spread);
+
+            dLo = MulDiv255Avx2(dLo, _mm256_sub_epi16(ones, aLo));
+            dHi = MulDiv255Avx2(dHi, _mm256_sub_epi16(ones, aHi));
+
+            _mm256_storeu_si256((__m256i*)dst, 
+                _mm256_adds_epu8(s, _mm256_packus_epi16(dLo, dHi)));
+        }
+        Blend32Sse2(dst, src, count);
+    }
+
+    // --- AVX-512 ---
+
+    RPE_TARGET("avx512f")
+    inline void Fill32Avx512(uint32_t* dst, size_t count, uint32_t color) {
+        __m512i v = _mm512_set1_epi32(int(color));
+
+        // Masked stores take care of both the head and the tail
+        size_t head = std::min(count, size_t((64 - (uintptr_t(dst) & 63)) & 63) / 4);
+        _mm512_mask_storeu_epi32(dst, __mmask16((1u << head) - 1), v);
+        dst += head, count -= head;
+
+        bool stream = count * 4 >= streamThreshold;
+
+        if (stream) {
+            for (; count >= 64; count -= 64, dst += 64) {
+                _mm512_stream_si512((__m512i*)dst, v);
+                _mm512_stream_si512((__m512i*)dst + 1, v);
+                _mm512_stream_si512((__m512i*)dst + 2, v);
+                _mm512_stream_si512((__m512i*)dst + 3, v);
+            }
+            _mm_sfence();
+        } else {
+            for (; count >= 64; count -= 64, dst += 64) {
+                _mm512_store_si512((__m512i*)dst, v);
+                _mm512_store_si512((__m512i*)dst + 1, v);
+                _mm512_store_si512((__m512i*)dst + 2, v);
+                _mm512_store_si512((__m512i*)dst + 3, v);
+            }
+        }
+
+        for (; count >= 16; count -= 16, dst += 16) _mm512_store_si512((__m512i*)dst, v);
+        _mm512_mask_storeu_epi32(dst, __mmask16((1u << count) - 1), v);
+    }
+
+    RPE_TARGET("avx512f")
+    inline void Expand8Avx512(uint32_t* dst, const uint8_t* src, size_t count, 
+        const uint32_t* palette) {
+        for (; count >= 16; count -= 16, dst += 16, src += 16) {
+            // Masked forms, the plain ones leave GCC 12 seeing an 
+            // uninitialized pass-through operand
+            __m512i index = _mm512_maskz_cvtepu8_epi32(0xffff, 
+                _mm_loadu_si128((const __m128i*)src));
+            _mm512_storeu_si512(dst, _mm512_mask_i32gather_epi32(
+                _mm512_setzero_si512(), 0xffff, index, palette, 4));
+        }
+        Expand8Scalar(dst, src, count, palette);
+    }
+
+    RPE_TARGET("avx512f")
+    inline void ColorKey32Avx512(uint32_t* dst, const uint32_t* src, size_t count, 
+        uint32_t key) {
+        __m512i k = _mm512_set1_epi32(int(key));
+
+        // Masked store writes just the non-key pixels, dst is never read
+        for (; count >= 16; count -= 16, dst += 16, src += 16) {
+            __m512i s = _mm512_loadu_si512(src);
+            _mm512_mask_storeu_epi32(dst, _mm512_cmpneq_epi32_mask(s, k), s);
+        }
+
+        __mmask16 tail = __mmask16((1u << count) - 1);
+        __m512i s = _mm512_maskz_loadu_epi32(tail, src);
+        _mm512_mask_storeu_epi32(dst, tail & _mm512_cmpneq_epi32_mask(s, k), s);
+    }
+#endif // RPE_KERNELS_X86
+
+#ifdef RPE_KERNELS_NEON
+    // --- NEON ---
+
+    inline void Fill32Neon(uint32_t* dst, size_t count, uint32_t color) {
+        uint32x4_t v = vdupq_n_u32(color);
+
+        for (; count >= 16; count -= 16, dst += 16) {
+            vst1q_u32(dst, v);
+            vst1q_u32(dst + 4, v);
+            vst1q_u32(dst + 8, v);
+            vst1q_u32(dst + 12, v);
+        }
+        for (; count >= 4; count -= 4, dst += 4) vst1q_u32(dst, v);
+        while (count--) *dst++ = color;
+    }
+
+    inline void ColorKey32Neon(uint32_t* dst, const uint32_t* src, size_t count, 
+        uint32_t key) {
+        uint32x4_t k = vdupq_n_u32(key);
+
+        for (; count >= 4; count -= 4, dst += 4, src += 4) {
+            uint32x4_t s = vld1q_u32(src);
+            vst1q_u32(dst, vbslq_u32(vceqq_u32(s, k), vld1q_u32(dst), s));
+        }
+        ColorKey32Scalar(dst, src, count, key);
+    }
+
+    inline void ColorKey8Neon(uint8_t* dst, const uint8_t* src, size_t count, 
+        uint8_t key) {
+        uint8x16_t k = vdupq_n_u8(key);
+
+        for (; count >= 16; count -= 16, dst += 16, src += 16) {
+            uint8x16_t s = vld1q_u8(src);
+            vst1q_u8(dst, vbslq_u8(vceqq_u8(s, k), vld1q_u8(dst), s));
+        }
+        ColorKey8Scalar(dst, src, count, key);
+    }
+
+    inline void Upscale32Neon(uint32_t* dst, const uint32_t* src, size_t count, 
+        unsigned int factor) {
+        if (factor == 2) {
+            for (; count >= 4; count -= 4, dst += 8, src += 4) {
+                uint32x4_t s = vld1q_u32(src);
+                vst2q_u32(dst, (uint32x4x2_t{ { s, s } }));
+            }
+        } else if (factor % 4 == 0) {
+            for (; count > 0; count--, src++) {
+                uint32x4_t s = vdupq_n_u32(*src);
+                for (unsigned int j = 0; j < factor; j += 4, dst += 4) vst1q_u32(dst, s);
+            }
+        }
+        Upscale32Scalar(dst, src, count, factor);
+    }
+
+    inline void Blend32Neon(uint32_t* dst, const uint32_t* src, size_t count) {
+        const uint16x8_t half = vdupq_n_u16(128);
+
+        // Eight pixels at a time, split into planes of b, g, r and a
+        for (; count >= 8; count -= 8, dst += 8, src += 8) {
+            uint8x8x4_t s = vld4_u8((const uint8_t*)src);
+            uint8x8x4_t d = vld4_u8((const uint8_t*)dst);
+            uint8x8_t inv = vmvn_u8(s.val[3]);
+
+            for (int c = 0; c < 4; c++) {
+                uint16x8_t t = vaddq_u16(vmull_u8(d.val[c], inv), half);
+                uint8x8_t scaled = vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+                d.val[c] = vqadd_u8(s.val[c], scaled);
+            }
+
+            vst4_u8((uint8_t*)dst, d);
+        }
+        Blend32Scalar(dst, src, count);
+    }
+#endif // RPE_KERNELS_NEON
+
+    // --- Dispatch ---
+
+    inline const KernelTable scalarKernels = { 
+        SimdLevel::SCALAR, "scalar", Fill32Scalar, ColorKey32Scalar, Blend32Scalar,
+        ColorKey8Scalar, Expand8Scalar, Upscale32Scalar
+    };
+#ifdef RPE_KERNELS_X86
+    inline const KernelTable sse2Kernels = { 
+        SimdLevel::SSE2, "sse2", Fill32Sse2, ColorKey32Sse2, Blend32Sse2,
+        ColorKey8Sse2, Expand8Sse2, Upscale32Sse2
+    };
+    inline const KernelTable avx2Kernels = { 
+        SimdLevel::AVX2, "avx2", Fill32Avx2, ColorKey32Avx2, Blend32Avx2,
+        ColorKey8Avx2, Expand8Avx2, Upscale32Avx2
+    };
+    // Byte and 16-bit lanes need AVX-512BW, AVX2 does those just fine
+    inline const KernelTable avx512Kernels = { 
+        SimdLevel::AVX512, "avx512", Fill32Avx512, ColorKey32Avx512, Blend32Avx2,
+        ColorKey8Avx2, Expand8Avx512, Upscale32Avx2
+    };
+#endif
+#ifdef RPE_KERNELS_NEON
+    inline const KernelTable neonKernels = { 
+        SimdLevel::NEON, "neon", Fill32Neon, ColorKey32Neon, Blend32Neon,
+        ColorKey8Neon, Expand8Scalar, Upscale32Neon
+    };
+#endif
+
+    /// Kernel table for a level, nullptr if this CPU (or build) can't run it
+    inline const KernelTable* KernelsFor(SimdLevel level) {
+        switch (level) {
+        case SimdLevel::SCALAR: return &scalarKernels;
+#ifdef RPE_KERNELS_X86
+        case SimdLevel::SSE2: 
+            return __builtin_cpu_supports("sse2") ? &sse2Kernels : nullptr;
+        case SimdLevel::AVX2: 
+            return __builtin_cpu_supports("avx2") ? &avx2Kernels : nullptr;
+        case SimdLevel::AVX512: 
+            return __builtin_cpu_supports("avx512f") ? &avx512Kernels : nullptr;
+#endif
+#ifdef RPE_KERNELS_NEON
+        case SimdLevel::NEON: return &neonKernels;
+#endif
+        default: return nullptr;
+        }
+    }
+
+    /// Best kernel table this CPU can run
+    inline const KernelTable* DetectKernels() {
+        const SimdLevel preference[] = { 
+            SimdLevel::AVX512, SimdLevel::AVX2, SimdLevel::NEON, SimdLevel::SSE2 
+        };
+
+        for (SimdLevel level : preference) {
+            if (const KernelTable* table = KernelsFor(level)) return table;
+        }
+        return &scalarKernels;
+    }
+
+    /// Kernel table in use, picked on first use
+    inline std::atomic<const KernelTable*> activeKernels{nullptr};
+
+    inline const KernelTable& Kernels() {
+        const KernelTable* table = activeKernels.load(std::memory_order_acquire);
+        if (table == nullptr) {
+            table = DetectKernels();
+            activeKernels.store(table, std::memory_order_release);
+        }
+        return *table;
+    }
+
+    /// Force a kernel table (for benchmarks and verification), returns 
+    /// false and keeps the current one if the CPU can't run it
+    inline bool SelectKernels(SimdLevel level) {
+        const KernelTable* table = KernelsFor(level);
+        if (table == nullptr) return false;
+        activeKernels.store(table, std::memory_order_release);
+        return true;
+    }
+
+    /// Run every kernel table the CPU supports against the scalar 
+    /// reference over assorted sizes and alignments. On a mismatch 
+    /// `failed` (if given) gets the table at fault
+    inline bool VerifyKernels(const KernelTable** failed = nullptr) {
+        const SimdLevel levels[] = { 
+            SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512, SimdLevel::NEON 
+        };
+        std::vector<uint32_t> expected(4096 + 64), actual(4096 + 64);
+
+        // Premultiplied source with every kind of alpha, a few color keys
+        std::vector<uint32_t> source(4096 + 64);
+        uint32_t seed = 1;
+        for (uint32_t& pixel : source) {
+            seed = seed * 1103515245 + 12345;
+            uint32_t a = (seed >> 8) & 0xff;
+            if ((seed >> 20) % 4 == 0) a = 0;
+            if ((seed >> 20) % 4 == 1) a = 255;
+
+            pixel = a << 24;
+            for (int shift = 0; shift < 24; shift += 8) {
+                pixel |= (((seed >> (shift / 2)) & 0xff) * a / 255) << shift;
+            }
+            if ((seed >> 24) % 5 == 0) pixel = 0xffff00ff;
+        }
+
+        for (SimdLevel level : levels) {
+            const KernelTable* table = KernelsFor(level);
+            if (table == nullptr) continue;
+            auto fail = [&]() {
+                if (failed != nullptr) *failed = table;
+                return false;
+            };
+
+            for (size_t offset = 0; offset < 16; offset++) {
+                for (size_t count : { 0, 1, 3, 7, 8, 15, 16, 17, 31, 64, 65, 
+                    129, 1000, 4096 }) {
+                    std::fill(expected.begin(), expected.end(), 0xdeadbeef);
+                    std::fill(actual.begin(), actual.end(), 0xdeadbeef);
+                    
+                    Fill32Scalar(expected.data() + offset, count, 0x12345678);
+                    table->Fill32(actual.data() + offset, count, 0x12345678);
+                    if (expected != actual) return fail();
+
+                    const uint32_t* src = source.data() + (offset * 7) % 16;
+                    ColorKey32Scalar(expected.data() + offset, src, count, 0xffff00ff);
+                    table->ColorKey32(actual.data() + offset, src, count, 0xffff00ff);
+                    if (expected != actual) return fail();
+
+                    Blend32Scalar(expected.data() + offset, src, count);
+                    table->Blend32(actual.data() + offset, src, count);
+                    if (expected != actual) return fail();
+
+                    // Palette is the source itself, indices its bytes
+                    const uint8_t* indices = (const uint8_t*)src;
+                    Expand8Scalar(expected.data() + offset, indices, count, src);
+                    table->Expand8(actual.data() + offset, indices, count, src);
+                    if (expected != actual) return fail();
+
+                    uint8_t* expected8 = (uint8_t*)expected.data() + offset;
+                    uint8_t* actual8 = (uint8_t*)actual.data() + offset;
+                    ColorKey8Scalar(expected8, indices + 3, count, 0xff);
+                    table->ColorKey8(actual8, indices + 3, count, 0xff);
+                    if (expected != actual) return fail();
+
+                    // Covers the special-cased 2x, 3x, 4x and 8x paths
+                    for (unsigned int factor = 1; factor <= 8; factor++) {
+                        if (count * factor > 4096) break;
+                        Upscale32Scalar(expected.data() + offset, src, count, factor);
+                        table->Upscale32(actual.data() + offset, src, count, factor);
+                        if (expected != actual) return fail();
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+}
+}
+#pragma endregion // SIMD KERNELS
+
 // ---------------------------
 // --- CLASSES AND STRUCTS ---
 // ---------------------------
@@ -23,36 +741,2673 @@ namespace rpe {
     /// Forward definition for RapturePixelEngine
     typedef class RapturePixelEngine;
 
-    /// POD (Plain old data) event object
-    struct Event {
-        /// Type of the occured event
-        enum class EventType : uint8_t {
-            NONE = 0,
-            KEY = 1,
-        } type;
-        
-        /// Specific for EventType::Key, defines key state
-        enum class KeyEventType { PRESS = 0, RELEASE = 1, };
+    /// POD (Plain old data) event object
+    struct Event {
+        /// Type of the occured event
+        enum class EventType : uint8_t {
+            NONE = 0,
+            KEY = 1,
+            /// Pointer moved, see MouseEvent
+            MOUSE_MOVE = 2,
+            /// Mouse button went down or up, see MouseEvent
+            MOUSE_BUTTON = 3,
+            /// Wheel turned, see MouseEvent
+            MOUSE_WHEEL = 4,
+        } type;
+        
+        /// Specific for EventType::Key, defines key state
+        enum class KeyEventType { PRESS = 0, RELEASE = 1, };
+
+        struct KeyEvent {
+            KeyEventType type;
+            /// Physical key, X keycodes run from 8 to 255. 
+            /// See Platform::KeyCode to find the one of a symbol
+            uint8_t keycode;
+        };
+
+        /// Specific for the MOUSE_* event types
+        struct MouseEvent {
+            /// Pointer position, in framebuffer pixels
+            int x, y;
+            /// MOUSE_MOVE, motion since the previous MOUSE_MOVE in window 
+            /// pixels (finer than framebuffer ones when scaled). Summed up 
+            /// over all the motion coalesced into this event.
+            /// MOUSE_WHEEL, steps turned, positive is up and right
+            int dx, dy;
+            /// MOUSE_BUTTON, whether the button went down or up
+            KeyEventType type;
+            /// MOUSE_BUTTON, 1 left, 2 middle, 3 right, 8 and 9 side ones
+            uint8_t button;
+        };
+
+        union {
+            KeyEvent keyEvent;
+            MouseEvent mouseEvent;
+        };
+
+        bool IsMouse() const { 
+            return type == EventType::MOUSE_MOVE || type == EventType::MOUSE_BUTTON || 
+                type == EventType::MOUSE_WHEEL; 
+        }
+
+        /// Create new empty event object
+        Event() : type(EventType::NONE) {}
+        /// Create a new event of a specific type
+        Event(EventType type) : type(type) {}
+
+        #ifdef __linux__
+        /// Forge a new event based on XEVENT
+        Event(const XEvent* xevent);
+        #endif
+    };
+
+
+    /// Input as of the current frame, kept up to date by the engine from
+    /// the events it dispatches, so gameplay code can just ask instead of
+    /// tracking state in callbacks. Read it on the engine thread
+    class InputState {
+    public:
+        /// Key is held down
+        bool Down(uint8_t keycode) const { return down.Test(keycode); }
+        /// Key went down during the current frame's event polling
+        bool Pressed(uint8_t keycode) const { return pressed.Test(keycode); }
+        /// Key went up during the current frame's event polling
+        bool Released(uint8_t keycode) const { return released.Test(keycode); }
+
+        /// Pointer position in framebuffer pixels
+        int mouseX = 0, mouseY = 0;
+        /// Pointer motion (window pixels) and wheel steps of this frame
+        int mouseDx = 0, mouseDy = 0, wheelX = 0, wheelY = 0;
+
+        /// Same as the key queries, for mouse buttons 1 to 31
+        bool ButtonDown(uint8_t button) const { return TestButton(buttonsDown, button); }
+        bool ButtonPressed(uint8_t button) const { return TestButton(buttonsPressed, button); }
+        bool ButtonReleased(uint8_t button) const { return TestButton(buttonsReleased, button); }
+
+        /// Fold an event in, done by RapturePixelEngine::DispatchEvent
+        void Apply(const Event& event) {
+            if (event.IsMouse()) {
+                ApplyMouse(event);
+                return;
+            }
+            if (event.type != Event::EventType::KEY) return;
+
+            uint8_t key = event.keyEvent.keycode;
+            if (event.keyEvent.type == Event::KeyEventType::PRESS) {
+                down.Set(key);
+                pressed.Set(key);
+            } else {
+                down.Reset(key);
+                released.Set(key);
+            }
+        }
+
+        /// Forget the edges of the previous frame, a tap within a single 
+        /// frame still shows as both Pressed and Released
+        void NewFrame() {
+            pressed = {};
+            released = {};
+            buttonsPressed = buttonsReleased = 0;
+            mouseDx = mouseDy = wheelX = wheelY = 0;
+        }
+
+    private:
+        /// One bit per keycode
+        struct KeySet {
+            uint64_t bits[4] = {};
+
+            bool Test(uint8_t key) const { return (bits[key >> 6] >> (key & 63)) & 1; }
+            void Set(uint8_t key) { bits[key >> 6] |= uint64_t(1) << (key & 63); }
+            void Reset(uint8_t key) { bits[key >> 6] &= ~(uint64_t(1) << (key & 63)); }
+        };
+
+        KeySet down, pressed, released;
+        uint32_t buttonsDown = 0, buttonsPressed = 0, buttonsReleased = 0;
+
+        static bool TestButton(uint32_t buttons, uint8_t button) {
+            return button < 32 && ((buttons >> button) & 1);
+        }
+
+        void ApplyMouse(const Event& event) {
+            const Event::MouseEvent& mouse = event.mouseEvent;
+            mouseX = mouse.x, mouseY = mouse.y;
+
+            if (event.type == Event::EventType::MOUSE_MOVE) {
+                mouseDx += mouse.dx, mouseDy += mouse.dy;
+            } else if (event.type == Event::EventType::MOUSE_WHEEL) {
+                wheelX += mouse.dx, wheelY += mouse.dy;
+            } else if (mouse.button < 32) {
+                uint32_t bit = uint32_t(1) << mouse.button;
+                if (mouse.type == Event::KeyEventType::PRESS) {
+                    buttonsDown |= bit, buttonsPressed |= bit;
+                } else {
+                    buttonsDown &= ~bit, buttonsReleased |= bit;
+                }
+            }
+        }
+    };
+
+    /// Binary log of a session's input: every frame's deltaTime and the
+    /// events dispatched during it, timestamped. Replayed, it hands the 
+    /// engine the very same frames again, which turns a recorded session
+    /// into a repeatable workload. See config.recordInput and 
+    /// config.replayInput. Native byte order, not meant to travel
+    class InputLog {
+    public:
+        /// "RPEI" in the first four bytes of the file
+        static constexpr uint32_t magic = 0x49455052;
+        static constexpr uint32_t version = 1;
+
+        InputLog() = default;
+        InputLog(const InputLog&) = delete;
+        InputLog& operator=(const InputLog&) = delete;
+        ~InputLog() { Close(); }
+
+        /// Start a new log, false if the file can't be written
+        bool Record(const char* path) {
+            Close();
+            file = fopen(path, "wb");
+            if (file == nullptr) return false;
+
+            uint32_t header[2] = { magic, version };
+            fwrite(header, sizeof(header), 1, file);
+            writing = true;
+            start = std::chrono::steady_clock::now();
+            return true;
+        }
+
+        /// Open a log to replay, false if it can't be read or isn't one
+        bool Replay(const char* path) {
+            Close();
+            file = fopen(path, "rb");
+            if (file == nullptr) return false;
+
+            uint32_t header[2] = {};
+            if (fread(header, sizeof(header), 1, file) != 1 || 
+                header[0] != magic || header[1] != version) {
+                Close();
+                return false;
+            }
+            writing = false;
+            return true;
+        }
+
+        void Close() {
+            if (file != nullptr) fclose(file);
+            file = nullptr;
+        }
+
+        bool Recording() const { return file != nullptr && writing; }
+        bool Replaying() const { return file != nullptr && !writing; }
+
+        /// Recording, a frame of `deltaTime` seconds begins
+        void WriteFrame(double deltaTime) {
+            fputc(FRAME, file);
+            fwrite(&deltaTime, sizeof(deltaTime), 1, file);
+        }
+
+        /// Recording, an event was dispatched. Events without a payload
+        /// (EventType::NONE) are left out
+        void WriteEvent(const Event& event) {
+            if (event.type == Event::EventType::NONE) return;
+
+            double time = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+            fputc(EVENT, file);
+            fwrite(&time, sizeof(time), 1, file);
+            fputc(int(event.type), file);
+
+            if (event.type == Event::EventType::KEY) {
+                fputc(int(event.keyEvent.type), file);
+                fputc(event.keyEvent.keycode, file);
+            } else {
+                const Event::MouseEvent& mouse = event.mouseEvent;
+                int32_t values[4] = { mouse.x, mouse.y, mouse.dx, mouse.dy };
+                fwrite(values, sizeof(values), 1, file);
+                fputc(int(mouse.type), file);
+                fputc(mouse.button, file);
+            }
+        }
+
+        /// Replaying, move to the next frame and get its deltaTime. 
+        /// False once the log is over (or broken)
+        bool ReadFrame(double& deltaTime) {
+            // Events the previous frame did not take are skipped
+            int tag;
+            while ((tag = fgetc(file)) == EVENT) {
+                Event skipped;
+                if (!ReadEventBody(skipped)) return false;
+            }
+            return tag == FRAME && fread(&deltaTime, sizeof(deltaTime), 1, file) == 1;
+        }
+
+        /// Replaying, hand each event of the current frame to `fn`
+        template <class Fn>
+        void ReadEvents(Fn&& fn) {
+            int tag;
+            while ((tag = fgetc(file)) == EVENT) {
+                Event event;
+                if (!ReadEventBody(event)) return;
+                fn(event);
+            }
+            if (tag != EOF) ungetc(tag, file);
+        }
+
+    private:
+        enum Tag : uint8_t { FRAME = 1, EVENT = 2 };
+
+        FILE* file = nullptr;
+        bool writing = false;
+        std::chrono::steady_clock::time_point start;
+
+        bool ReadEventBody(Event& event) {
+            double time;
+            if (fread(&time, sizeof(time), 1, file) != 1) return false;
+
+            event.type = Event::EventType(fgetc(file));
+            if (event.type == Event::EventType::KEY) {
+                event.keyEvent.type = Event::KeyEventType(fgetc(file));
+                event.keyEvent.keycode = uint8_t(fgetc(file));
+            } else {
+                int32_t values[4];
+                if (fread(values, sizeof(values), 1, file) != 1) return false;
+                event.mouseEvent = { values[0], values[1], values[2], values[3], 
+                    Event::KeyEventType(fgetc(file)), uint8_t(fgetc(file)) };
+            }
+            return !feof(file);
+        }
+    };
+
+    /// Lock-free single-producer/single-consumer ring buffer. 
+    /// One thread may Push, one (other) thread may Pop, nothing else.
+    /// Capacity has to be a power of two
+    template <class T, size_t Capacity>
+    class SpscRing {
+        static_assert((Capacity & (Capacity - 1)) == 0, 
+            "SpscRing capacity has to be a power of two");
+
+    public:
+        /// Producer side, returns false (and counts an overflow) when full
+        bool Push(const T& value) {
+            size_t tail = this->tail.load(std::memory_order_relaxed);
+
+            if (tail - cachedHead == Capacity) {
+                cachedHead = head.load(std::memory_order_acquire);
+                if (tail - cachedHead == Capacity) {
+                    overflows.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+            }
+
+            slots[tail & (Capacity - 1)] = value;
+            this->tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Consumer side, returns false when empty
+        bool Pop(T& value) {
+            size_t head = this->head.load(std::memory_order_relaxed);
+
+            if (head == cachedTail) {
+                cachedTail = tail.load(std::memory_order_acquire);
+                if (head == cachedTail) return false;
+            }
+
+            value = slots[head & (Capacity - 1)];
+            this->head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /// Consumer side, hand every available element to `fn`, 
+        /// returns how many there were
+        template <class Fn>
+        size_t Drain(Fn&& fn) {
+            size_t count = 0;
+            T value;
+            while (Pop(value)) {
+                fn(value);
+                count++;
+            }
+            return count;
+        }
+
+        /// Elements waiting, only a hint while the other side is active
+        size_t Size() const {
+            return tail.load(std::memory_order_acquire) - 
+                head.load(std::memory_order_acquire);
+        }
+
+        /// Elements dropped because the ring was full
+        uint64_t Overflows() const { 
+            return overflows.load(std::memory_order_relaxed); 
+        }
+
+    private:
+        // Producer and consumer indices live on their own cache lines so
+        // the two threads don't keep stealing them from each other
+        alignas(64) std::atomic<size_t> tail{0};
+        size_t cachedHead = 0;
+        alignas(64) std::atomic<size_t> head{0};
+        size_t cachedTail = 0;
+        alignas(64) std::atomic<uint64_t> overflows{0};
+        T slots[Capacity];
+    };
+
+    /// Where the time of a frame goes. Zones are timed by RAII markers 
+    /// and pushed to a lock-free ring owned by their thread; the engine 
+    /// collects the rings once per frame and Export() writes the capture 
+    /// in Chrome's trace format (chrome://tracing, ui.perfetto.dev).
+    /// Only compiled in when RPE_PROFILER is defined before the include,
+    /// otherwise the RPE_PROFILE_* macros are empty
+    namespace profiler {
+        using Clock = std::chrono::steady_clock;
+
+        inline int64_t Now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now().time_since_epoch()).count();
+        }
+
+        /// Zone timestamps. On x86 the time stamp counter, a few times 
+        /// cheaper to read than the clock, converted to nanoseconds on 
+        /// export. Plain nanoseconds elsewhere
+        inline int64_t Ticks() {
+        #ifdef RPE_KERNELS_X86
+            return int64_t(__rdtsc());
+        #else
+            return Now();
+        #endif
+        }
+
+        /// One timed zone, `name` has to outlive the capture (literals do)
+        struct Record {
+            const char* name;
+            int64_t begin, end;
+        };
+
+        /// Zones of one thread, pushed by it and popped by Collect()
+        struct ThreadLog {
+            SpscRing<Record, 1 << 14> ring;
+            uint32_t id = 0;
+            std::string name;
+        };
+
+        class Profiler {
+        public:
+            /// Most records kept, the oldest ones go first
+            size_t maxRecords = 1 << 20;
+
+            /// Never destroyed, threads may still close zones during exit
+            static inline Profiler* instance() {
+                static Profiler* profiler = new Profiler();
+                return profiler;
+            }
+
+            /// Log of the calling thread, registered on its first zone
+            ThreadLog& ThisThread() {
+                thread_local ThreadLog* log = Register();
+                return *log;
+            }
+
+            /// Name the calling thread in the trace
+            void NameThread(const char* name) {
+                ThreadLog& log = ThisThread();
+                std::lock_guard<std::mutex> guard(mtx);
+                log.name = name;
+            }
+
+            /// Move the zones of every thread into the capture
+            void Collect() {
+                std::lock_guard<std::mutex> guard(mtx);
+
+                for (auto& log : threads) {
+                    uint32_t id = log->id;
+                    log->ring.Drain([&](const Record& record) {
+                        captured.push_back({ record, id });
+                    });
+                }
+                while (captured.size() > maxRecords) captured.pop_front();
+            }
+
+            /// Zones dropped because a thread's ring was full between 
+            /// two Collect() calls
+            uint64_t Dropped() {
+                std::lock_guard<std::mutex> guard(mtx);
+                uint64_t dropped = 0;
+                for (auto& log : threads) dropped += log->ring.Overflows();
+                return dropped;
+            }
+
+            void Clear() {
+                Collect();
+                std::lock_guard<std::mutex> guard(mtx);
+                captured.clear();
+            }
+
+            /// Write the capture as Chrome trace JSON, false if the file 
+            /// can't be written
+            bool Export(const char* path) {
+                Collect();
+                std::lock_guard<std::mutex> guard(mtx);
+
+                FILE* file = fopen(path, "w");
+                if (file == nullptr) return false;
+
+                int64_t origin = captured.empty() ? 0 : captured.front().record.begin;
+                for (const Captured& c : captured) origin = std::min(origin, c.record.begin);
+                double nsPerTick = NanosecondsPerTick();
+
+                fprintf(file, "{\"traceEvents\":[\n");
+                bool first = true;
+                for (auto& log : threads) {
+                    if (log->name.empty()) continue;
+                    fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+                        "\"tid\":%u,\"args\":{\"name\":\"%s\"}}", 
+                        first ? "" : ",\n", log->id, log->name.c_str());
+                    first = false;
+                }
+                for (const Captured& c : captured) {
+                    fprintf(file, "%s{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%u,"
+                        "\"ts\":%.3f,\"dur\":%.3f}", first ? "" : ",\n", c.record.name, 
+                        c.thread, (c.record.begin - origin) * nsPerTick / 1e3, 
+                        (c.record.end - c.record.begin) * nsPerTick / 1e3);
+                    first = false;
+                }
+                fprintf(file, "\n]}\n");
+
+                return fclose(file) == 0;
+            }
+
+        private:
+            Profiler() : startTicks(Ticks()), startNs(Now()) {}
+
+            /// Tick rate measured since the profiler was made, over at 
+            /// least 10 ms
+            double NanosecondsPerTick() const {
+            #ifdef RPE_KERNELS_X86
+                while (Now() - startNs < 10000000) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                return double(Now() - startNs) / double(Ticks() - startTicks);
+            #else
+                return 1.0;
+            #endif
+            }
+
+            int64_t startTicks, startNs;
+
+            struct Captured {
+                Record record;
+                uint32_t thread;
+            };
+
+            std::mutex mtx;
+            /// Kept until exit, a trace may outlive its threads
+            std::vector<std::unique_ptr<ThreadLog>> threads;
+            std::deque<Captured> captured;
+
+            ThreadLog* Register() {
+                std::lock_guard<std::mutex> guard(mtx);
+                threads.push_back(std::make_unique<ThreadLog>());
+                threads.back()->id = uint32_t(threads.size());
+                return threads.back().get();
+            }
+        };
+
+        /// Times its own scope, see RPE_PROFILE_SCOPE
+        class Zone {
+        public:
+            explicit Zone(const char* name) : name(name), begin(Ticks()) {}
+            ~Zone() {
+                Profiler::instance()->ThisThread().ring.Push({ name, begin, Ticks() });
+            }
+
+            Zone(const Zone&) = delete;
+            Zone& operator=(const Zone&) = delete;
+
+        private:
+            const char* name;
+            int64_t begin;
+        };
+    }
+
+#ifdef RPE_PROFILER
+#define RPE_PROFILE_CONCAT_(a, b) a##b
+#define RPE_PROFILE_CONCAT(a, b) RPE_PROFILE_CONCAT_(a, b)
+/// Time the rest of the enclosing scope under a (string literal) name
+#define RPE_PROFILE_SCOPE(name) \
+    ::rpe::profiler::Zone RPE_PROFILE_CONCAT(rpeProfileZone, __LINE__)(name)
+#define RPE_PROFILE_FUNCTION() RPE_PROFILE_SCOPE(__func__)
+/// Name the calling thread in the trace
+#define RPE_PROFILE_THREAD(name) ::rpe::profiler::Profiler::instance()->NameThread(name)
+/// Gather every thread's zones, the engine does it once per frame
+#define RPE_PROFILE_COLLECT() ::rpe::profiler::Profiler::instance()->Collect()
+#else
+#define RPE_PROFILE_SCOPE(name) ((void)0)
+#define RPE_PROFILE_FUNCTION() ((void)0)
+#define RPE_PROFILE_THREAD(name) ((void)0)
+#define RPE_PROFILE_COLLECT() ((void)0)
+#endif
+
+    /// Allocator handing out cache line aligned memory, so vector kernels
+    /// start on an aligned boundary
+    template <class T, size_t Alignment = 64>
+    struct AlignedAllocator {
+        using value_type = T;
+
+        template <class U>
+        struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+        AlignedAllocator() = default;
+        template <class U>
+        AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+        T* allocate(size_t n) {
+            size_t bytes = (n * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+            void* memory = aligned_alloc(Alignment, bytes);
+            if (memory == nullptr) throw std::bad_alloc();
+            return (T*)memory;
+        }
+
+        void deallocate(T* p, size_t) { free(p); }
+
+        template <class U>
+        bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+        template <class U>
+        bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+    };
+
+    /// Pack 8-bit channels into a framebuffer pixel (0xAARRGGBB)
+    constexpr uint32_t Rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
+        return (uint32_t(a) << 24) | (uint32_t(r) << 16) | 
+            (uint32_t(g) << 8) | uint32_t(b);
+    }
+
+    /// Axis aligned rectangle, `x + width` and `y + height` are exclusive
+    struct Rect {
+        int x = 0, y = 0, width = 0, height = 0;
+
+        /// Covers every coordinate that matters, used as "no clipping"
+        static constexpr Rect Unbounded() { return { 0, 0, INT32_MAX, INT32_MAX }; }
+
+        bool Empty() const { return width <= 0 || height <= 0; }
+        int64_t Area() const { return Empty() ? 0 : int64_t(width) * height; }
+
+        /// Smallest rectangle holding both
+        Rect Union(const Rect& other) const {
+            if (Empty()) return other;
+            if (other.Empty()) return *this;
+
+            int x0 = std::min(x, other.x), y0 = std::min(y, other.y);
+            int x1 = std::max(x + width, other.x + other.width);
+            int y1 = std::max(y + height, other.y + other.height);
+            return { x0, y0, x1 - x0, y1 - y0 };
+        }
+
+        /// Overlapping part of both, empty if they don't touch
+        Rect Intersect(const Rect& other) const {
+            int x0 = std::max(x, other.x), y0 = std::max(y, other.y);
+            int x1 = std::min(x + width, other.x + other.width);
+            int y1 = std::min(y + height, other.y + other.height);
+            if (x0 >= x1 || y0 >= y1) return {};
+            return { x0, y0, x1 - x0, y1 - y0 };
+        }
+    };
+
+    /// Point on the framebuffer, in pixels
+    struct Point {
+        int x = 0, y = 0;
+    };
+
+    /// How a sprite's pixels land on the framebuffer
+    enum class BlitMode : uint8_t {
+        /// Copied as they are
+        OPAQUE = 0,
+        /// Copied, except for the ones equal to Sprite::colorKey
+        COLOR_KEY = 1,
+        /// Blended over, pixels have to be premultiplied by their alpha
+        ALPHA = 2,
+    };
+
+    /// What a pixel of a framebuffer or sprite is
+    enum class PixelMode : uint8_t {
+        /// 32-bit 0xAARRGGBB color
+        RGBA32 = 0,
+        /// 8-bit index into a 256 color palette, expanded on presentation
+        INDEXED8 = 1,
+    };
+
+    /// Pixel formats for Surface, each one packs and unpacks 0xAARRGGBB 
+    /// colors. Names give the byte order in memory (little-endian), so 
+    /// BGRA8888 is the layout of the engine framebuffer itself
+    namespace format {
+        /// Premultiplied "over" of two 0xAARRGGBB colors, Blend32Scalar 
+        /// for a single pixel
+        constexpr uint32_t Over(uint32_t dst, uint32_t src) {
+            uint32_t inv = 255 - (src >> 24), out = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                uint32_t c = ((src >> shift) & 0xff) + 
+                    kernels::Div255(((dst >> shift) & 0xff) * inv);
+                out |= std::min<uint32_t>(c, 255) << shift;
+            }
+            return out;
+        }
+
+        /// Shared part of the direct color formats, blending unpacks, 
+        /// blends and packs again
+        template <class Format, class PixelType>
+        struct PackedFormat {
+            using Pixel = PixelType;
+            static constexpr bool indexed = false;
+
+            static constexpr Pixel Blend(Pixel dst, uint32_t src) {
+                return Format::Pack(Over(Format::Unpack(dst), src));
+            }
+        };
+
+        struct BGRA8888 : PackedFormat<BGRA8888, uint32_t> {
+            static constexpr Pixel Pack(uint32_t color) { return color; }
+            static constexpr uint32_t Unpack(Pixel pixel) { return pixel; }
+            static constexpr Pixel Blend(Pixel dst, uint32_t src) { return Over(dst, src); }
+        };
+
+        struct RGBA8888 : PackedFormat<RGBA8888, uint32_t> {
+            /// Red and blue trade places, the swap is its own inverse
+            static constexpr Pixel Pack(uint32_t color) {
+                return (color & 0xff00ff00) | ((color >> 16) & 0xff) | 
+                    ((color & 0xff) << 16);
+            }
+            static constexpr uint32_t Unpack(Pixel pixel) { return Pack(pixel); }
+        };
+
+        struct RGB565 : PackedFormat<RGB565, uint16_t> {
+            static constexpr Pixel Pack(uint32_t color) {
+                return Pixel(((color >> 8) & 0xf800) | ((color >> 5) & 0x07e0) | 
+                    ((color >> 3) & 0x001f));
+            }
+            /// Top bits repeated into the low ones, so 0x1f becomes 0xff
+            static constexpr uint32_t Unpack(Pixel pixel) {
+                uint32_t r = pixel >> 11, g = (pixel >> 5) & 0x3f, b = pixel & 0x1f;
+                return 0xff000000 | (((r << 3) | (r >> 2)) << 16) | 
+                    (((g << 2) | (g >> 4)) << 8) | ((b << 3) | (b >> 2));
+            }
+        };
+
+        struct Gray8 : PackedFormat<Gray8, uint8_t> {
+            /// BT.601 luma in 8-bit fixed point, weights sum up to 256
+            static constexpr Pixel Pack(uint32_t color) {
+                return Pixel((((color >> 16) & 0xff) * 77 + ((color >> 8) & 0xff) * 150 + 
+                    (color & 0xff) * 29 + 128) >> 8);
+            }
+            static constexpr uint32_t Unpack(Pixel pixel) {
+                return 0xff000000 | uint32_t(pixel) * 0x010101;
+            }
+        };
+
+        /// Palette indices, "colors" are the indices themselves like in 
+        /// PixelMode::INDEXED8. Blending just overwrites, the palette 
+        /// is only needed when converting to another format
+        struct Indexed8 {
+            using Pixel = uint8_t;
+            static constexpr bool indexed = true;
+
+            static constexpr Pixel Pack(uint32_t color) { return Pixel(color); }
+            static constexpr uint32_t Unpack(Pixel pixel) { return pixel; }
+            static constexpr Pixel Blend(Pixel, uint32_t src) { return Pack(src); }
+        };
+
+        /// Convert `count` pixels from one format to another, compiled into
+        /// a single loop for every pair. Indexed sources need `palette`
+        template <class Dst, class Src>
+        inline void ConvertRow(typename Dst::Pixel* dst, const typename Src::Pixel* src, 
+            size_t count, const uint32_t* palette = nullptr) {
+            static_assert(!Dst::indexed || Src::indexed, 
+                "Converting to indexed colors needs a palette search, not provided");
+
+            if constexpr (std::is_same<Dst, Src>::value) {
+                memcpy(dst, src, count * sizeof(*src));
+            } else if constexpr (Src::indexed) {
+                for (size_t i = 0; i < count; i++) dst[i] = Dst::Pack(palette[src[i]]);
+            } else {
+                for (size_t i = 0; i < count; i++) dst[i] = Dst::Pack(Src::Unpack(src[i]));
+            }
+        }
+    }
+
+    /// Image in one of the `format` pixel formats, every pixel operation is
+    /// specialised for it at compile time
+    template <class Format>
+    class Surface {
+    public:
+        using Pixel = typename Format::Pixel;
+
+        unsigned int width = 0, height = 0;
+
+        Surface() = default;
+        Surface(unsigned int width, unsigned int height) { Resize(width, height); }
+
+        /// (Re)allocate the pixel storage, contents are cleared to 0
+        void Resize(unsigned int width, unsigned int height) {
+            this->width = width, this->height = height;
+            storage.assign(size_t(width) * height, Pixel(0));
+        }
+
+        Pixel* Data() { return storage.data(); }
+        const Pixel* Data() const { return storage.data(); }
+
+        Pixel* Row(unsigned int y) { return Data() + size_t(y) * width; }
+        const Pixel* Row(unsigned int y) const { return Data() + size_t(y) * width; }
+
+        Rect Bounds() const { return { 0, 0, int(width), int(height) }; }
+
+        void SetPixel(int x, int y, uint32_t color) {
+            if (x < 0 || y < 0 || x >= int(width) || y >= int(height)) return;
+            Row(y)[x] = Format::Pack(color);
+        }
+
+        uint32_t GetPixel(int x, int y) const {
+            if (x < 0 || y < 0 || x >= int(width) || y >= int(height)) return 0;
+            return Format::Unpack(Row(y)[x]);
+        }
+
+        /// Blend a premultiplied color over a pixel
+        void BlendPixel(int x, int y, uint32_t color) {
+            if (x < 0 || y < 0 || x >= int(width) || y >= int(height)) return;
+            Row(y)[x] = Format::Blend(Row(y)[x], color);
+        }
+
+        void Clear(uint32_t color) {
+            std::fill(storage.begin(), storage.end(), Format::Pack(color));
+        }
+
+        void FillRect(int x, int y, int width, int height, uint32_t color) {
+            Rect target = Rect{ x, y, width, height }.Intersect(Bounds());
+            if (target.Empty()) return;
+
+            Pixel pixel = Format::Pack(color);
+            for (int row = target.y; row < target.y + target.height; row++) {
+                std::fill_n(Row(row) + target.x, target.width, pixel);
+            }
+        }
+
+        /// Copy another surface in with its top left corner at x, y, 
+        /// converting the pixels. Indexed sources need their palette
+        template <class Other>
+        void CopyFrom(const Surface<Other>& other, int x = 0, int y = 0, 
+            const uint32_t* palette = nullptr) {
+            Rect target = Rect{ x, y, int(other.width), int(other.height) }
+                .Intersect(Bounds());
+            if (target.Empty()) return;
+
+            for (int row = target.y; row < target.y + target.height; row++) {
+                format::ConvertRow<Format, Other>(Row(row) + target.x, 
+                    other.Row(row - y) + (target.x - x), target.width, palette);
+            }
+        }
+
+    private:
+        std::vector<Pixel, AlignedAllocator<Pixel>> storage;
+    };
+
+    /// Image to be blitted onto the framebuffer, 0xAARRGGBB pixels or 
+    /// palette indices. Blits need the sprite and the framebuffer to 
+    /// share their PixelMode
+    class Sprite {
+    public:
+        unsigned int width = 0, height = 0;
+        /// Mode used by Blit() calls that don't name one
+        BlitMode mode = BlitMode::OPAQUE;
+        /// Transparent color (or index) in BlitMode::COLOR_KEY
+        uint32_t colorKey = 0xffff00ff;
+        PixelMode pixelMode = PixelMode::RGBA32;
+
+        Sprite() = default;
+        Sprite(unsigned int width, unsigned int height, 
+            BlitMode mode = BlitMode::OPAQUE, 
+            PixelMode pixelMode = PixelMode::RGBA32) : mode(mode) {
+            Resize(width, height, pixelMode);
+        }
+
+        /// (Re)allocate the pixel storage, contents are cleared to 0
+        void Resize(unsigned int width, unsigned int height) {
+            Resize(width, height, pixelMode);
+        }
+
+        void Resize(unsigned int width, unsigned int height, PixelMode pixelMode) {
+            this->width = width, this->height = height, this->pixelMode = pixelMode;
+            size_t bytes = size_t(width) * height * (pixelMode == PixelMode::INDEXED8 ? 1 : 4);
+            storage.assign((bytes + 3) / 4, 0);
+        }
+
+        /// Raw row-major pixel storage, `width` pixels per row.
+        /// RGBA32 sprites only
+        uint32_t* Data() { return storage.data(); }
+        const uint32_t* Data() const { return storage.data(); }
+
+        uint32_t* Row(unsigned int y) { return Data() + size_t(y) * width; }
+        const uint32_t* Row(unsigned int y) const { 
+            return Data() + size_t(y) * width; 
+        }
+
+        /// Palette indices of a row, INDEXED8 sprites only
+        uint8_t* IndexRow(unsigned int y) { 
+            return (uint8_t*)storage.data() + size_t(y) * width; 
+        }
+        const uint8_t* IndexRow(unsigned int y) const { 
+            return (const uint8_t*)storage.data() + size_t(y) * width; 
+        }
+
+        /// Set a pixel to a color, or an index in INDEXED8
+        void SetPixel(int x, int y, uint32_t color) {
+            if (x < 0 || y < 0 || x >= int(width) || y >= int(height)) return;
+            if (pixelMode == PixelMode::INDEXED8) {
+                IndexRow(y)[x] = uint8_t(color);
+            } else {
+                Row(y)[x] = color;
+            }
+        }
+
+        uint32_t GetPixel(int x, int y) const {
+            if (x < 0 || y < 0 || x >= int(width) || y >= int(height)) return 0;
+            if (pixelMode == PixelMode::INDEXED8) return IndexRow(y)[x];
+            return Row(y)[x];
+        }
+
+        /// Convert straight alpha pixels to the premultiplied ones 
+        /// BlitMode::ALPHA expects
+        void Premultiply() {
+            if (pixelMode != PixelMode::RGBA32) return;
+
+            for (uint32_t& pixel : storage) {
+                uint32_t a = pixel >> 24, out = a << 24;
+                for (int shift = 0; shift < 24; shift += 8) {
+                    out |= kernels::Div255(((pixel >> shift) & 0xff) * a) << shift;
+                }
+                pixel = out;
+            }
+        }
+
+    private:
+        std::vector<uint32_t, AlignedAllocator<uint32_t>> storage;
+    };
+
+    /// A string laid out in a BitmapFont, as the spans of its ink. Drawing it
+    /// is filling those, see Framebuffer::DrawText
+    struct TextRun {
+        /// `length` pixels of ink from x, y, relative to the top left
+        /// corner of the text. Ink past the int16_t range is left out
+        struct Span {
+            int16_t x, y;
+            uint16_t length;
+        };
+
+        /// By row, then from left to right, touching spans merged
+        std::vector<Span> spans;
+        /// Area the ink covers, relative to the top left corner
+        Rect bounds;
+    };
+
+    /// Bitmap font, each glyph kept as the spans of its ink, one color.
+    /// Loaded from BDF, or from a PPM atlas of equally sized cells. 
+    /// Covers the 256 byte values, text is drawn byte by byte
+    class BitmapFont {
+    public:
+        struct Glyph {
+            /// Pen movement to the next glyph
+            int advance = 0;
+            /// Range of the glyph's spans in spans, relative to the pen 
+            /// position and the top of the line
+            uint32_t firstSpan = 0, spanCount = 0;
+        };
+
+        /// Pixels of the line above and below the baseline
+        int ascent = 0, descent = 0;
+
+        /// Laid out strings kept by Cached()
+        static constexpr size_t cacheSize = 256;
+
+        int LineHeight() const { return ascent + descent; }
+
+        const Glyph& GetGlyph(uint8_t character) const { return glyphs[character]; }
+
+        /// Load a BDF font, glyphs with encodings past 255 are left out.
+        /// False if the file can't be read or isn't BDF
+        bool LoadBdf(const char* path) {
+            FILE* file = fopen(path, "r");
+            if (file == nullptr) return false;
+
+            char line[1024];
+            if (fgets(line, sizeof(line), file) == nullptr || strncmp(line, "STARTFONT", 9) != 0) {
+                fclose(file);
+                return false;
+            }
+            Reset();
+
+            bool ascentGiven = false, descentGiven = false;
+            int encoding = -1, advance = 0, w = 0, h = 0, x = 0, y = 0;
+
+            while (fgets(line, sizeof(line), file) != nullptr) {
+                int a, b, c, d;
+                if (sscanf(line, "FONTBOUNDINGBOX %d %d %d %d", &a, &b, &c, &d) == 4) {
+                    if (!ascentGiven) ascent = b + d;
+                    if (!descentGiven) descent = -d;
+                } else if (sscanf(line, "FONT_ASCENT %d", &a) == 1) {
+                    ascent = a, ascentGiven = true;
+                } else if (sscanf(line, "FONT_DESCENT %d", &a) == 1) {
+                    descent = a, descentGiven = true;
+                } else if (sscanf(line, "ENCODING %d", &a) == 1) {
+                    encoding = a;
+                } else if (sscanf(line, "DWIDTH %d", &a) == 1) {
+                    advance = a;
+                } else if (sscanf(line, "BBX %d %d %d %d", &a, &b, &c, &d) == 4) {
+                    w = a, h = b, x = c, y = d;
+                } else if (strncmp(line, "BITMAP", 6) == 0) {
+                    Glyph glyph = { advance, uint32_t(spans.size()), 0 };
+
+                    // Rows of hex digits, the leftmost pixel in the top bit.
+                    // Glyphs that don't fit in a line, or rows too short 
+                    // for the width, are left out
+                    size_t digits = (size_t(std::max(w, 0)) + 7) / 8 * 2;
+                    bool valid = w >= 0 && h >= 0 && h <= 1024 && digits < sizeof(line);
+                    int top = ascent - (y + h);
+                    for (int row = 0; valid && row < h; row++) {
+                        valid = fgets(line, sizeof(line), file) != nullptr && 
+                            strspn(line, "0123456789abcdefABCDEF") >= digits;
+                        if (!valid) break;
+
+                        AddRow(w, x, top + row, [&](int column) {
+                            char digit[2] = { line[column / 4], 0 };
+                            return (strtoul(digit, nullptr, 16) >> (3 - column % 4)) & 1;
+                        });
+                    }
+
+                    glyph.spanCount = uint32_t(spans.size()) - glyph.firstSpan;
+                    if (valid && encoding >= 0 && encoding < 256) {
+                        glyphs[encoding] = glyph, defined[encoding] = true;
+                    } else {
+                        spans.resize(glyph.firstSpan);
+                    }
+                }
+            }
+
+            fclose(file);
+            FillMissing();
+            return true;
+        }
+
+        /// Load a binary PPM (P6) cut into `cellWidth` by `cellHeight` 
+        /// cells, left to right and top to bottom, the first one being 
+        /// character `first`. Bright pixels are ink. False if the file 
+        /// can't be read or isn't a PPM
+        bool LoadAtlas(const char* path, int cellWidth, int cellHeight, int first = 32) {
+            FILE* file = fopen(path, "rb");
+            if (file == nullptr) return false;
+
+            // Header numbers, skipping white space and comments
+            auto number = [file]() {
+                int c = fgetc(file), value = 0;
+                while (c == '#' || isspace(c)) {
+                    if (c == '#') while (c != '\n' && c != EOF) c = fgetc(file);
+                    c = fgetc(file);
+                }
+                if (!isdigit(c)) return -1;
+                for (; isdigit(c); c = fgetc(file)) value = value * 10 + (c - '0');
+                return value;
+            };
+
+            std::vector<uint8_t> pixels;
+            int width = -1, height = -1, maximum = -1;
+            if (fgetc(file) == 'P' && fgetc(file) == '6') {
+                width = number(), height = number(), maximum = number();
+            }
+            if (width > 0 && height > 0 && maximum > 0 && maximum < 256) {
+                pixels.resize(size_t(width) * height * 3);
+                if (fread(pixels.data(), pixels.size(), 1, file) != 1) pixels.clear();
+            }
+            fclose(file);
+            if (pixels.empty() || cellWidth <= 0 || cellHeight <= 0) return false;
+
+            Reset();
+            ascent = cellHeight;
+
+            int columns = width / cellWidth, rows = height / cellHeight;
+            for (int cell = 0; cell < columns * rows && first + cell < 256; cell++) {
+                if (first + cell < 0) continue;
+                Glyph glyph = { cellWidth, uint32_t(spans.size()), 0 };
+                int left = cell % columns * cellWidth, top = cell / columns * cellHeight;
+
+                for (int row = 0; row < cellHeight; row++) {
+                    const uint8_t* line = &pixels[(size_t(top + row) * width + left) * 3];
+                    AddRow(cellWidth, 0, row, [&](int column) {
+                        const uint8_t* rgb = line + column * 3;
+                        return (rgb[0] + rgb[1] + rgb[2]) * 2 > maximum * 3;
+                    });
+                }
+
+                glyph.spanCount = uint32_t(spans.size()) - glyph.firstSpan;
+                glyphs[first + cell] = glyph, defined[first + cell] = true;
+            }
+
+            FillMissing();
+            return true;
+        }
+
+        /// Size of a text's layout box without drawing it: the widest
+        /// line by the number of lines ('\n' starts a new one)
+        Rect Measure(const char* text) const {
+            int width = 0, pen = 0, lines = 1;
+            for (const char* c = text; *c != 0; c++) {
+                if (*c == '\n') {
+                    lines++, pen = 0;
+                } else {
+                    pen += glyphs[uint8_t(*c)].advance;
+                    width = std::max(width, pen);
+                }
+            }
+            return { 0, 0, width, lines * LineHeight() };
+        }
+
+        /// Lay a text out into `run`, the top left corner at 0, 0
+        void Layout(const char* text, TextRun& run) const {
+            run.spans.clear();
+            long long pen = 0, top = 0;
+
+            for (const char* c = text; *c != 0; c++) {
+                if (*c == '\n') {
+                    top += LineHeight(), pen = 0;
+                    continue;
+                }
+                const Glyph& glyph = glyphs[uint8_t(*c)];
+                for (uint32_t i = 0; i < glyph.spanCount; i++) {
+                    TextRun::Span span = spans[glyph.firstSpan + i];
+                    long long x = span.x + pen, y = span.y + top;
+                    // Ink past what a Span holds is off any framebuffer
+                    if (x < INT16_MIN || x + span.length > INT16_MAX) continue;
+                    if (y < INT16_MIN || y > INT16_MAX) continue;
+                    span.x = int16_t(x), span.y = int16_t(y);
+                    run.spans.push_back(span);
+                }
+                pen += glyph.advance;
+            }
+
+            // Row by row, so neighbouring glyphs' ink becomes one fill
+            std::sort(run.spans.begin(), run.spans.end(), 
+                [](const TextRun::Span& a, const TextRun::Span& b) {
+                    return a.y != b.y ? a.y < b.y : a.x < b.x;
+                });
+
+            size_t merged = 0;
+            run.bounds = {};
+            for (const TextRun::Span& span : run.spans) {
+                TextRun::Span& last = run.spans[merged - (merged > 0)];
+                if (merged > 0 && span.y == last.y && span.x <= last.x + last.length) {
+                    // Both ends are in int16_t, so the length fits
+                    last.length = uint16_t(std::max(last.x + last.length, span.x + span.length) - last.x);
+                } else {
+                    run.spans[merged++] = span;
+                }
+                run.bounds = run.bounds.Union({ span.x, span.y, span.length, 1 });
+            }
+            run.spans.resize(merged);
+        }
+
+        /// Layout of a text, laid out once and then kept, so a string 
+        /// drawn every frame (a frame counter, a label) is only drawn. 
+        /// Valid until the next call. Not thread safe
+        const TextRun& Cached(const char* text) const {
+            // FNV-1a
+            uint64_t hash = 14695981039346656037ull;
+            for (const char* c = text; *c != 0; c++) {
+                hash = (hash ^ uint8_t(*c)) * 1099511628211ull;
+            }
+
+            auto found = cache.find(hash);
+            if (found != cache.end() && found->second.text == text) {
+                return found->second.run;
+            }
+
+            // Full, start over rather than track what's old
+            if (cache.size() >= cacheSize) cache.clear();
+
+            CachedRun& entry = cache[hash];
+            entry.text = text;
+            Layout(text, entry.run);
+            return entry.run;
+        }
+
+    private:
+        Glyph glyphs[256];
+        bool defined[256] = {};
+        /// Ink of every glyph
+        std::vector<TextRun::Span> spans;
+
+        struct CachedRun {
+            std::string text;
+            TextRun run;
+        };
+        mutable std::unordered_map<uint64_t, CachedRun> cache;
+
+        void Reset() {
+            std::fill(std::begin(glyphs), std::end(glyphs), Glyph());
+            std::fill(std::begin(defined), std::end(defined), false);
+            spans.clear();
+            cache.clear();
+            ascent = descent = 0;
+        }
+
+        /// Add the ink of a glyph row as spans, `ink(column)` tells 
+        /// whether a pixel is set
+        template <class Ink>
+        void AddRow(int width, int x, int y, Ink&& ink) {
+            for (int column = 0; column < width;) {
+                if (!ink(column)) {
+                    column++;
+                    continue;
+                }
+                int start = column;
+                while (column < width && ink(column)) column++;
+                spans.push_back({ int16_t(x + start), int16_t(y), uint16_t(column - start) });
+            }
+        }
+
+        /// Characters the font doesn't have show as '?' if it has that
+        void FillMissing() {
+            if (!defined[uint8_t('?')]) return;
+            for (int c = 0; c < 256; c++) {
+                if (!defined[c] && c != '\n') glyphs[c] = glyphs[uint8_t('?')];
+            }
+        }
+    };
+
+    /// CPU-side framebuffer. In PixelMode::RGBA32 every pixel is 
+    /// 0xAARRGGBB, in PixelMode::INDEXED8 a palette index, with the
+    /// palette applied on presentation. Colors passed to the drawing 
+    /// calls are indices in that mode.
+    /// Drawing calls record the damaged (changed) area, so presentation
+    /// only sends what changed. Writing through Data() or Row() directly
+    /// has to be reported with Damage() to show up
+    class Framebuffer {
+    public:
+        unsigned int width = 0, height = 0;
+        PixelMode mode = PixelMode::RGBA32;
+        /// Record damage when drawing. Turned off while several threads 
+        /// draw at once (see TileRasterizer), whoever does that reports 
+        /// the damage afterwards
+        bool trackDamage = true;
+
+        /// Damaged rectangles kept apart before they get merged
+        static constexpr size_t maxDamageRects = 16;
+        /// Pixels a merge may waste and still count as cheaper than an 
+        /// additional rectangle, i.e. the per-request cost of presenting
+        static constexpr int64_t damageMergeSlack = 4096;
+
+        /// (Re)allocate the pixel storage, contents are cleared to black
+        /// (or index 0)
+        void Resize(unsigned int width, unsigned int height, 
+            PixelMode mode = PixelMode::RGBA32) {
+            this->width = width, this->height = height, this->mode = mode;
+
+            if (mode == PixelMode::INDEXED8) {
+                storage.assign((size_t(width) * height + 3) / 4, 0);
+            } else {
+                storage.assign(size_t(width) * height, Rgba(0, 0, 0));
+            }
+            DamageAll();
+        }
+
+        /// Colors of the palette indices in INDEXED8 mode
+        const uint32_t* Palette() const { return palette; }
+
+        /// Change palette entries. Every pixel may change color, so 
+        /// everything is presented again
+        void SetPalette(const uint32_t* colors, unsigned int count, 
+            unsigned int first = 0) {
+            count = std::min(count, 256 - std::min(first, 256u));
+            std::copy(colors, colors + count, palette + first);
+            if (mode == PixelMode::INDEXED8) DamageAll();
+        }
+
+        void SetPalette(unsigned int index, uint32_t color) {
+            SetPalette(&color, 1, index);
+        }
+
+        /// Whole framebuffer as a rectangle
+        Rect Bounds() const { return { 0, 0, int(width), int(height) }; }
+
+        /// Mark an area as changed since the last presentation
+        void Damage(Rect rect) {
+            rect = rect.Intersect(Bounds());
+            if (rect.Empty() || fullDamage || !trackDamage) return;
+
+            // Fold into whatever it is cheap to fold into, the grown
+            // rectangle may then swallow others as well
+            for (size_t i = 0; i < damage.size();) {
+                Rect merged = damage[i].Union(rect);
+                if (merged.Area() <= damage[i].Area() + rect.Area() + damageMergeSlack) {
+                    rect = merged;
+                    damage[i] = damage.back();
+                    damage.pop_back();
+                    i = 0;
+                } else {
+                    i++;
+                }
+            }
+
+            damage.push_back(rect);
+
+            if (damage.size() > maxDamageRects) MergeCheapestDamage();
+
+            // Mostly damaged anyway, one big request beats many
+            int64_t area = 0;
+            for (const Rect& r : damage) area += r.Area();
+            if (area * 2 > Bounds().Area()) DamageAll();
+        }
+
+        /// Mark everything as changed
+        void DamageAll() {
+            if (!trackDamage) return;
+            damage.assign(1, Bounds());
+            fullDamage = true;
+        }
+
+        /// Forget the damage, called once the frame is presented
+        void ClearDamage() {
+            damage.clear();
+            fullDamage = false;
+        }
+
+        /// Areas changed since the last presentation
+        const std::vector<Rect>& DamagedRects() const { return damage; }
+
+        /// Raw row-major pixel storage, `width` pixels per row. 
+        /// RGBA32 mode only
+        uint32_t* Data() { return storage.data(); }
+        const uint32_t* Data() const { return storage.data(); }
+
+        /// Pointer to the first pixel of a row, RGBA32 mode only
+        uint32_t* Row(unsigned int y) { return Data() + size_t(y) * width; }
+        const uint32_t* Row(unsigned int y) const { 
+            return Data() + size_t(y) * width; 
+        }
+
+        /// Palette indices of a row, INDEXED8 mode only
+        uint8_t* IndexRow(unsigned int y) { 
+            return (uint8_t*)storage.data() + size_t(y) * width; 
+        }
+        const uint8_t* IndexRow(unsigned int y) const { 
+            return (const uint8_t*)storage.data() + size_t(y) * width; 
+        }
+
+        /// Fill the whole framebuffer with a single color
+        void Clear(uint32_t color) {
+            if (mode == PixelMode::INDEXED8) {
+                memset(storage.data(), uint8_t(color), size_t(width) * height);
+            } else {
+                kernels::Kernels().Fill32(storage.data(), storage.size(), color);
+            }
+            DamageAll();
+        }
+
+        /// Set a single pixel, out of bounds coordinates are ignored
+        void SetPixel(int x, int y, uint32_t color) {
+            if (x < 0 || y < 0 || x >= int(width) || y >= int(height)) return;
+            if (mode == PixelMode::INDEXED8) {
+                IndexRow(y)[x] = uint8_t(color);
+            } else {
+                Row(y)[x] = color;
+            }
+            Damage({ x, y, 1, 1 });
+        }
+
+        /// Get a single pixel, out of bounds coordinates give 0
+        uint32_t GetPixel(int x, int y) const {
+            if (x < 0 || y < 0 || x >= int(width) || y >= int(height)) return 0;
+            if (mode == PixelMode::INDEXED8) return IndexRow(y)[x];
+            return Row(y)[x];
+        }
+
+
+        /// Fill a rectangle, clipped to `clip` and the framebuffer
+        void FillRect(int x, int y, int w, int h, uint32_t color, 
+            Rect clip = Rect::Unbounded()) {
+            Rect rect = Rect{ x, y, w, h }.Intersect(Bounds()).Intersect(clip);
+            if (rect.Empty()) return;
+
+            if (mode == PixelMode::INDEXED8) {
+                for (int row = rect.y; row < rect.y + rect.height; row++) {
+                    memset(IndexRow(row) + rect.x, uint8_t(color), rect.width);
+                }
+            } else {
+                auto fill = kernels::Kernels().Fill32;
+                for (int row = rect.y; row < rect.y + rect.height; row++) {
+                    fill(Row(row) + rect.x, rect.width, color);
+                }
+            }
+            Damage(rect);
+        }
+
+        /// Draw a sprite with its top left corner at x, y, in its own mode
+        void Blit(const Sprite& sprite, int x, int y) {
+            Blit(sprite, x, y, sprite.mode);
+        }
+
+        /// Draw a sprite with its top left corner at x, y
+        void Blit(const Sprite& sprite, int x, int y, BlitMode mode) {
+            BlitPart(sprite, { 0, 0, int(sprite.width), int(sprite.height) }, 
+                x, y, mode);
+        }
+
+        /// Draw the `source` part of a sprite with its top left corner at 
+        /// x, y, clipped to `clip` (and the framebuffer). 
+        /// Indexed sprites know no alpha, BlitMode::ALPHA blits them as 
+        /// BlitMode::COLOR_KEY
+        void BlitPart(const Sprite& sprite, Rect source, int x, int y, 
+            BlitMode mode, Rect clip = Rect::Unbounded()) {
+            if (sprite.pixelMode != this->mode) return;
+
+            // Clipped once up front, the row loops never check a pixel
+            source = source.Intersect({ 0, 0, int(sprite.width), int(sprite.height) });
+            Rect target = Rect{ x, y, source.width, source.height }
+                .Intersect(Bounds()).Intersect(clip);
+            if (target.Empty()) return;
+
+            int sx = source.x + target.x - x, sy = source.y + target.y - y;
+            const kernels::KernelTable& k = kernels::Kernels();
+
+            if (this->mode == PixelMode::INDEXED8) {
+                for (int row = 0; row < target.height; row++) {
+                    uint8_t* dst = IndexRow(target.y + row) + target.x;
+                    const uint8_t* src = sprite.IndexRow(sy + row) + sx;
+
+                    if (mode == BlitMode::OPAQUE) {
+                        memcpy(dst, src, target.width);
+                    } else {
+                        k.ColorKey8(dst, src, target.width, uint8_t(sprite.colorKey));
+                    }
+                }
+
+                Damage(target);
+                return;
+            }
+
+            for (int row = 0; row < target.height; row++) {
+                uint32_t* dst = Row(target.y + row) + target.x;
+                const uint32_t* src = sprite.Row(sy + row) + sx;
+
+                switch (mode) {
+                case BlitMode::OPAQUE:
+                    memcpy(dst, src, target.width * sizeof(uint32_t));
+                    break;
+                case BlitMode::COLOR_KEY:
+                    k.ColorKey32(dst, src, target.width, sprite.colorKey);
+                    break;
+                case BlitMode::ALPHA:
+                    k.Blend32(dst, src, target.width);
+                    break;
+                }
+            }
+
+            Damage(target);
+        }
+
+        /// Fill the pixels x0 <= x < x1 of row y, clipped to `clip` (and
+        /// the framebuffer)
+        void FillSpan(int x0, int x1, int y, uint32_t color, 
+            Rect clip = Rect::Unbounded()) {
+            Rect target = Rect{ x0, y, x1 - x0, 1 }.Intersect(Bounds()).Intersect(clip);
+            if (target.Empty()) return;
+            Span(target.x, target.x + target.width, y, color, target);
+            Damage(target);
+        }
+
+        /// Draw a one pixel wide line, both end points included. 
+        /// Bresenham, the runs of a flat line are filled as spans
+        void DrawLine(int x0, int y0, int x1, int y1, uint32_t color, 
+            Rect clip = Rect::Unbounded()) {
+            clip = clip.Intersect(Bounds());
+            Rect area = LineBounds(x0, y0, x1, y1).Intersect(clip);
+            if (area.Empty()) return;
+
+            // Walked along the longer axis from the lower end, a steep 
+            // line is a flat one with the axes swapped
+            bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+            if (steep) std::swap(x0, y0), std::swap(x1, y1);
+            if (x0 > x1) std::swap(x0, x1), std::swap(y0, y1);
+
+            int first = steep ? area.y : area.x;
+            int last = (steep ? area.y + area.height : area.x + area.width) - 1;
+            first = std::max(first, x0), last = std::min(last, x1);
+
+            // The minor coordinate of step i is y0 + (2i dy + dx) / 2dx, 
+            // a clipped line starts right at its first visible pixel and 
+            // still matches the whole one (tiles rely on that)
+            int64_t dx = x1 - x0, dy = std::abs(y1 - y0), sy = y1 < y0 ? -1 : 1;
+            int64_t step = 2 * dy, denominator = 2 * std::max<int64_t>(dx, 1);
+            int64_t numerator = (first - x0) * step + dx;
+            int y = y0 + int(sy * (numerator / denominator));
+            int64_t error = numerator % denominator;
+
+            for (int x = first; x <= last;) {
+                int start = x;
+                bool move = false;
+                while (!move && x <= last) {
+                    x++, error += step;
+                    if (error >= denominator) error -= denominator, move = true;
+                }
+
+                if (steep) {
+                    for (int row = start; row < x; row++) Span(y, y + 1, row, color, clip);
+                } else {
+                    Span(start, x, y, color, clip);
+                }
+                if (move) y += int(sy);
+            }
+
+            Damage(area);
+        }
+
+        /// Draw an anti-aliased line, coordinates are in pixels like for 
+        /// DrawLine() but may fall in between. Xiaolin Wu's, every step 
+        /// along the longer axis blends the two pixels the line passes 
+        /// between. The color is premultiplied like a sprite's. Indexed 
+        /// framebuffers have nothing to blend with and get DrawLine()
+        void DrawLineAA(float x0, float y0, float x1, float y1, uint32_t color, 
+            Rect clip = Rect::Unbounded()) {
+            if (mode == PixelMode::INDEXED8) {
+                DrawLine(int(std::lround(x0)), int(std::lround(y0)), 
+                    int(std::lround(x1)), int(std::lround(y1)), color, clip);
+                return;
+            }
+
+            clip = clip.Intersect(Bounds());
+            Rect area = LineBoundsAA(x0, y0, x1, y1).Intersect(clip);
+            if (area.Empty()) return;
+
+            bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+            if (steep) std::swap(x0, y0), std::swap(x1, y1);
+            if (x0 > x1) std::swap(x0, x1), std::swap(y0, y1);
+
+            float gradient = x1 > x0 ? (y1 - y0) / (x1 - x0) : 0.0f;
+            auto plot = [&](int x, int y, float coverage) {
+                if (steep) std::swap(x, y);
+                if (x < clip.x || y < clip.y || x >= clip.x + clip.width || 
+                    y >= clip.y + clip.height) return;
+                BlendCoverage(Row(y)[x], color, coverage);
+            };
+
+            // End points only cover the part of their pixel the line 
+            // reaches into
+            int start = int(std::floor(x0 + 0.5f)), end = int(std::floor(x1 + 0.5f));
+            float startY = y0 + gradient * (start - x0), endY = y1 + gradient * (end - x1);
+            float startGap = 1.0f - (x0 + 0.5f - std::floor(x0 + 0.5f));
+            float endGap = x1 + 0.5f - std::floor(x1 + 0.5f);
+
+            auto plotEnd = [&](int x, float y, float gap) {
+                float row = std::floor(y), fraction = y - row;
+                plot(x, int(row), (1.0f - fraction) * gap);
+                plot(x, int(row) + 1, fraction * gap);
+            };
+            plotEnd(start, startY, startGap);
+            if (end != start) plotEnd(end, endY, endGap);
+
+            // Computed from the start at each step rather than summed up,
+            // so any clipped part comes out the same
+            int first = steep ? area.y : area.x;
+            int last = (steep ? area.y + area.height : area.x + area.width) - 1;
+            first = std::max(first, start + 1), last = std::min(last, end - 1);
+
+            for (int x = first; x <= last; x++) {
+                float y = startY + gradient * float(x - start);
+                float row = std::floor(y), fraction = y - row;
+                plot(x, int(row), 1.0f - fraction);
+                plot(x, int(row) + 1, fraction);
+            }
+
+            Damage(area);
+        }
+
+        /// Draw the outline of an ellipse around cx, cy reaching `rx` and
+        /// `ry` pixels to either side. Each row of the outline is a span
+        void DrawEllipse(int cx, int cy, int rx, int ry, uint32_t color, 
+            Rect clip = Rect::Unbounded()) {
+            Ellipse(cx, cy, rx, ry, color, clip, false);
+        }
+
+        /// Fill an ellipse around cx, cy reaching `rx` and `ry` pixels to
+        /// either side, one span per row
+        void FillEllipse(int cx, int cy, int rx, int ry, uint32_t color, 
+            Rect clip = Rect::Unbounded()) {
+            Ellipse(cx, cy, rx, ry, color, clip, true);
+        }
+
+        void DrawCircle(int cx, int cy, int radius, uint32_t color, 
+            Rect clip = Rect::Unbounded()) {
+            Ellipse(cx, cy, radius, radius, color, clip, false);
+        }
+
+        void FillCircle(int cx, int cy, int radius, uint32_t color, 
+            Rect clip = Rect::Unbounded()) {
+            Ellipse(cx, cy, radius, radius, color, clip, true);
+        }
+
+        /// Fill a polygon, convex, concave or crossing itself (even-odd
+        /// rule). Points are pixel corners like the corners of FillRect(),
+        /// a pixel is in when its center is. Scanline fill over an edge 
+        /// table, spans between each row's crossings
+        void FillPolygon(const Point* points, size_t count, uint32_t color, 
+            Rect clip = Rect::Unbounded()) {
+            clip = clip.Intersect(Bounds());
+            Rect area = PolygonBounds(points, count).Intersect(clip);
+            if (count < 3 || area.Empty()) return;
+
+            // Row y samples y + 0.5, an edge crosses it at numerator / 
+            // denominator and numerator grows by `step` a row. Exact, so 
+            // clipped parts match the whole polygon
+            struct Edge { int top, bottom; int64_t numerator, step, denominator; int x; };
+            // Per thread, tiles fill polygons in parallel
+            static thread_local std::vector<Edge> edges, active;
+            edges.clear(), active.clear();
+
+            for (size_t i = 0; i < count; i++) {
+                Point a = points[i], b = points[(i + 1) % count];
+                if (a.y == b.y) continue;
+                if (a.y > b.y) std::swap(a, b);
+
+                int64_t dy = b.y - a.y, dx = b.x - a.x;
+                edges.push_back({ a.y, b.y, 2 * dy * a.x + dx, 2 * dx, 2 * dy, 0 });
+            }
+            std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+                return a.top < b.top;
+            });
+
+            size_t next = 0;
+            for (int y = area.y; y < area.y + area.height; y++) {
+                // Edges reaching this row join, finished ones leave
+                for (; next < edges.size() && edges[next].top <= y; next++) {
+                    Edge edge = edges[next];
+                    if (edge.bottom <= y) continue;
+                    edge.numerator += (y - edge.top) * edge.step;
+                    active.push_back(edge);
+                }
+                active.erase(std::remove_if(active.begin(), active.end(), 
+                    [y](const Edge& edge) { return edge.bottom <= y; }), active.end());
+
+                // First pixel right of the crossing, its center is inside:
+                // ceil(x - 0.5), sorted by insertion as the order barely 
+                // changes from row to row
+                for (size_t i = 0; i < active.size(); i++) {
+                    Edge& edge = active[i];
+                    int64_t n = 2 * edge.numerator - edge.denominator, d = 2 * edge.denominator;
+                    edge.x = int(n >= 0 ? (n + d - 1) / d : -(-n / d));
+                    edge.numerator += edge.step;
+
+                    for (size_t j = i; j > 0 && active[j - 1].x > active[j].x; j--) {
+                        std::swap(active[j - 1], active[j]);
+                    }
+                }
+
+                for (size_t i = 0; i + 1 < active.size(); i += 2) {
+                    Span(active[i].x, active[i + 1].x, y, color, clip);
+                }
+            }
+
+            Damage(area);
+        }
+
+        void FillPolygon(const std::vector<Point>& points, uint32_t color, 
+            Rect clip = Rect::Unbounded()) {
+            FillPolygon(points.data(), points.size(), color, clip);
+        }
+
+        /// Draw a text with the top left corner of its first line at x, y.
+        /// Strings seen before are only drawn, see BitmapFont::Cached
+        void DrawText(const BitmapFont& font, int x, int y, const char* text, 
+            uint32_t color, Rect clip = Rect::Unbounded()) {
+            DrawText(font.Cached(text), x, y, color, clip);
+        }
+
+        /// Draw laid out text with its top left corner at x, y
+        void DrawText(const TextRun& run, int x, int y, uint32_t color, 
+            Rect clip = Rect::Unbounded()) {
+            FillSpans(run.spans.data(), run.spans.size(), x, y, color, clip);
+        }
+
+        /// Fill spans placed relative to x, y and sorted by row, like 
+        /// those of a TextRun
+        void FillSpans(const TextRun::Span* spans, size_t count, int x, int y, 
+            uint32_t color, Rect clip = Rect::Unbounded()) {
+            clip = clip.Intersect(Bounds());
+            Rect area;
+
+            for (size_t i = 0; i < count; i++) {
+                int row = y + spans[i].y;
+                if (row < clip.y) continue;
+                if (row >= clip.y + clip.height) break;
+
+                int x0 = x + spans[i].x, x1 = x0 + spans[i].length;
+                Span(x0, x1, row, color, clip);
+                area = area.Union(Rect{ x0, row, x1 - x0, 1 }.Intersect(clip));
+            }
+
+            Damage(area);
+        }
+
+        /// Areas the primitives above may touch
+        static Rect LineBounds(int x0, int y0, int x1, int y1) {
+            return { std::min(x0, x1), std::min(y0, y1), 
+                std::abs(x1 - x0) + 1, std::abs(y1 - y0) + 1 };
+        }
+
+        static Rect LineBoundsAA(float x0, float y0, float x1, float y1) {
+            int left = int(std::floor(std::min(x0, x1))) - 1;
+            int top = int(std::floor(std::min(y0, y1))) - 1;
+            return { left, top, int(std::ceil(std::max(x0, x1))) + 3 - left, 
+                int(std::ceil(std::max(y0, y1))) + 3 - top };
+        }
+
+        static Rect EllipseBounds(int cx, int cy, int rx, int ry) {
+            if (rx < 0 || ry < 0) return {};
+            return { cx - rx, cy - ry, 2 * rx + 1, 2 * ry + 1 };
+        }
+
+        static Rect PolygonBounds(const Point* points, size_t count) {
+            if (count == 0) return {};
+            int x0 = points[0].x, y0 = points[0].y, x1 = x0, y1 = y0;
+            for (size_t i = 1; i < count; i++) {
+                x0 = std::min(x0, points[i].x), x1 = std::max(x1, points[i].x);
+                y0 = std::min(y0, points[i].y), y1 = std::max(y1, points[i].y);
+            }
+            return { x0, y0, x1 - x0, y1 - y0 };
+        }
+
+        /// Trade pixels and damage with a framebuffer of the same size 
+        /// and mode, in constant time. Palettes stay where they are
+        void SwapPixels(Framebuffer& other) {
+            storage.swap(other.storage);
+            damage.swap(other.damage);
+            std::swap(fullDamage, other.fullDamage);
+        }
+
+        /// Copy an area over from a framebuffer of the same size and 
+        /// mode, without damaging it
+        void CopyPixels(const Framebuffer& from, Rect rect) {
+            rect = rect.Intersect(Bounds()).Intersect(from.Bounds());
+            if (rect.Empty()) return;
+
+            size_t bytes = mode == PixelMode::INDEXED8 ? 1 : sizeof(uint32_t);
+            for (int y = rect.y; y < rect.y + rect.height; y++) {
+                size_t offset = (size_t(y) * width + rect.x) * bytes;
+                memcpy((char*)storage.data() + offset, 
+                    (const char*)from.storage.data() + offset, rect.width * bytes);
+            }
+        }
+
+    private:
+        /// Pixels, four indices per element in INDEXED8 mode
+        std::vector<uint32_t, AlignedAllocator<uint32_t>> storage;
+        uint32_t palette[256] = {};
+        /// Changed areas, see Damage()
+        std::vector<Rect> damage;
+        /// `damage` covers everything, no point in tracking more
+        bool fullDamage = false;
+
+        /// Fill x0 <= x < x1 of row y, clipped to `clip` which has to lie 
+        /// within the framebuffer. No damage, that's the caller's
+        void Span(int x0, int x1, int y, uint32_t color, const Rect& clip) {
+            if (y < clip.y || y >= clip.y + clip.height) return;
+            x0 = std::max(x0, clip.x), x1 = std::min(x1, clip.x + clip.width);
+            if (x0 >= x1) return;
+
+            if (mode == PixelMode::INDEXED8) {
+                memset(IndexRow(y) + x0, uint8_t(color), x1 - x0);
+            } else if (x1 - x0 < 8) {
+                // Not worth a kernel call
+                std::fill(Row(y) + x0, Row(y) + x1, color);
+            } else {
+                kernels::Kernels().Fill32(Row(y) + x0, x1 - x0, color);
+            }
+        }
+
+        /// Blend a premultiplied color covering 0 to 1 of a pixel over it.
+        /// Two channels at a time in 8.8 fixed point, coverage is only 
+        /// ever approximate anyway
+        static void BlendCoverage(uint32_t& pixel, uint32_t color, float coverage) {
+            uint32_t scale = uint32_t(std::clamp(coverage, 0.0f, 1.0f) * 256.0f + 0.5f);
+            uint32_t src = (((color & 0x00ff00ff) * scale >> 8) & 0x00ff00ff) | 
+                ((((color >> 8) & 0x00ff00ff) * scale) & 0xff00ff00);
+            uint32_t inv = 256 - (src >> 24);
+            pixel = src + ((((pixel & 0x00ff00ff) * inv) >> 8) & 0x00ff00ff) + 
+                ((((pixel >> 8) & 0x00ff00ff) * inv) & 0xff00ff00);
+        }
+
+        void Ellipse(int cx, int cy, int rx, int ry, uint32_t color, Rect clip, 
+            bool fill) {
+            // Big enough for any framebuffer, small enough for int64_t below
+            rx = std::min(rx, 1 << 14), ry = std::min(ry, 1 << 14);
+            clip = clip.Intersect(Bounds());
+            Rect area = EllipseBounds(cx, cy, rx, ry).Intersect(clip);
+            if (area.Empty()) return;
+
+            // A pixel is in when its center lies within half a pixel of
+            // the radii, the ones the midpoint algorithm picks:
+            // (2x)^2 (2ry + 1)^2 + (2y)^2 (2rx + 1)^2 <= (2rx + 1)^2 (2ry + 1)^2.
+            // Rows are walked from the top, where the half width can only
+            // grow, and the outline of a row spans what the row above 
+            // did not reach
+            int64_t a = int64_t(2 * rx + 1) * (2 * rx + 1);
+            int64_t b = int64_t(2 * ry + 1) * (2 * ry + 1), limit = a * b;
+            int half = 0, above = -1;
+
+            for (int y = ry; y >= 0; y--) {
+                int64_t rowTerm = 4 * int64_t(y) * y * a;
+                while (half < rx && 4 * int64_t(half + 1) * (half + 1) * b + rowTerm <= limit) {
+                    half++;
+                }
+
+                int inner = fill ? 0 : std::min(above + 1, half);
+                for (int row : { cy - y, cy + y }) {
+                    if (inner == 0) {
+                        Span(cx - half, cx + half + 1, row, color, clip);
+                    } else {
+                        Span(cx - half, cx - inner + 1, row, color, clip);
+                        Span(cx + inner, cx + half + 1, row, color, clip);
+                    }
+                    if (y == 0) break;
+                }
+                above = half;
+            }
+
+            Damage(area);
+        }
+
+        /// Replace the pair of damaged rectangles whose union wastes the 
+        /// least area with that union
+        void MergeCheapestDamage() {
+            size_t bestA = 0, bestB = 1;
+            int64_t bestCost = INT64_MAX;
+
+            for (size_t a = 0; a < damage.size(); a++) {
+                for (size_t b = a + 1; b < damage.size(); b++) {
+                    int64_t cost = damage[a].Union(damage[b]).Area() - 
+                        damage[a].Area() - damage[b].Area();
+                    if (cost < bestCost) bestCost = cost, bestA = a, bestB = b;
+                }
+            }
+
+            Rect merged = damage[bestA].Union(damage[bestB]);
+            damage[bestB] = damage.back();
+            damage.pop_back();
+            damage[bestA] = damage.back();
+            damage.pop_back();
+            
+            // Re-added so it can swallow whatever it now overlaps
+            Damage(merged);
+        }
+    };
+
+    /// Finished frames on their way to the screen (see config.swapChain).
+    /// The engine keeps drawing into its own framebuffer: Submit() trades
+    /// its pixels for those of a spare buffer, which a thread of its own 
+    /// then presents. Spares are behind by the damage of every frame 
+    /// since they were last submitted, and that much is copied over from 
+    /// the newest frame when one comes back, like EGL's buffer age
+    class SwapChain {
+    public:
+        /// Behind-areas kept apart before they are merged into one
+        static constexpr size_t maxStaleRects = 16;
+
+        /// Frames Submit() had to wait for, every buffer being in flight
+        std::atomic<uint64_t> stalls{ 0 };
+
+        SwapChain() = default;
+        SwapChain(const SwapChain&) = delete;
+        SwapChain& operator=(const SwapChain&) = delete;
+        ~SwapChain() { Stop(); }
+
+        /// Start the present thread with `depth` buffers in total, the
+        /// engine's own framebuffer (which the spares copy) included.
+        /// `present` is called on that thread for every frame in order,
+        /// `setup` before the first one and `teardown` after the last.
+        /// Returns once `setup` is done, whatever it sets up is then 
+        /// visible to the caller too
+        void Start(unsigned int depth, const Framebuffer& framebuffer, 
+            std::function<void()> setup, 
+            std::function<void(const Framebuffer&)> present,
+            std::function<void()> teardown) {
+            Stop();
+
+            depth = std::max(depth, 2u);
+            buffers.assign(depth - 1, framebuffer);
+            stale.assign(depth - 1, {});
+            free.clear();
+            for (size_t slot = 0; slot < buffers.size(); slot++) free.push_back(slot);
+            queued.clear();
+            quit = false;
+            ready = false;
+
+            thread = std::thread([this, setup, present, teardown]() {
+                setup();
+                {
+                    std::lock_guard<std::mutex> guard(mtx);
+                    ready = true;
+                }
+                signal.notify_all();
+
+                PresentLoop(present);
+                teardown();
+            });
+
+            std::unique_lock<std::mutex> guard(mtx);
+            signal.wait(guard, [this]() { return ready; });
+        }
+
+        /// Present whatever is still queued, then end the present thread
+        void Stop() {
+            if (!thread.joinable()) return;
+            {
+                std::lock_guard<std::mutex> guard(mtx);
+                quit = true;
+            }
+            signal.notify_all();
+            thread.join();
+        }
+
+        bool Active() const { return thread.joinable(); }
+
+        /// Queue a finished frame for presentation. `framebuffer` comes 
+        /// back holding the same picture, in a buffer that was free, and 
+        /// with its damage cleared. Blocks while every buffer is in flight
+        void Submit(Framebuffer& framebuffer) {
+            RPE_PROFILE_SCOPE("Submit");
+            std::unique_lock<std::mutex> guard(mtx);
+            if (free.empty()) {
+                stalls.fetch_add(1, std::memory_order_relaxed);
+                signal.wait(guard, [this]() { return !free.empty(); });
+            }
 
-        struct KeyEvent {
-            KeyEventType type;
+            size_t slot = free.back();
+            free.pop_back();
+
+            // The frame moves into `slot`, everyone else falls behind it
+            for (size_t i = 0; i < stale.size(); i++) {
+                if (i != slot) AddStale(stale[i], framebuffer.DamagedRects());
+            }
+            behind.swap(stale[slot]);
+            stale[slot].clear();
+            AddStale(behind, framebuffer.DamagedRects());
+            guard.unlock();
+
+            Framebuffer& spare = buffers[slot];
+            spare.SetPalette(framebuffer.Palette(), 256);
+            framebuffer.SwapPixels(spare);
+            framebuffer.ClearDamage();
+
+            guard.lock();
+            queued.push_back(slot);
+            guard.unlock();
+            signal.notify_all();
+
+            // Both sides only read `spare` from here on
+            for (const Rect& rect : behind) framebuffer.CopyPixels(spare, rect);
+            behind.clear();
+        }
+
+    private:
+        /// Spare framebuffers, the engine's own is not among them
+        std::vector<Framebuffer> buffers;
+        /// Per spare, the areas it is behind the newest frame
+        std::vector<std::vector<Rect>> stale;
+        /// Areas the engine framebuffer has to catch up on after Submit
+        std::vector<Rect> behind;
+        /// Spares ready to be drawn into, and the ones waiting for (or 
+        /// going through, the front one) presentation
+        std::vector<size_t> free;
+        std::deque<size_t> queued;
+        std::mutex mtx;
+        std::condition_variable signal;
+        std::thread thread;
+        bool quit = false;
+        /// The present thread is done with `setup`
+        bool ready = false;
+
+        void PresentLoop(const std::function<void(const Framebuffer&)>& present) {
+            std::unique_lock<std::mutex> guard(mtx);
+
+            for (;;) {
+                signal.wait(guard, [this]() { return quit || !queued.empty(); });
+                if (queued.empty()) break;
+
+                size_t slot = queued.front();
+                guard.unlock();
+                present(buffers[slot]);
+                guard.lock();
+
+                queued.pop_front();
+                free.push_back(slot);
+                signal.notify_all();
+            }
+        }
+
+        static void AddStale(std::vector<Rect>& list, const std::vector<Rect>& rects) {
+            list.insert(list.end(), rects.begin(), rects.end());
+            if (list.size() <= maxStaleRects) return;
+
+            Rect all = list[0];
+            for (const Rect& rect : list) all = all.Union(rect);
+            list.assign(1, all);
+        }
+    };
+
+    /// Work-stealing job scheduler. Every worker owns a deque: it pushes 
+    /// and pops its own jobs at the back (newest first, still in cache) 
+    /// while idle workers steal from the front of the others. Threads 
+    /// outside the pool share one extra deque, and whoever waits for a 
+    /// job runs jobs meanwhile instead of blocking.
+    /// A job may have a parent, which only counts as finished once all 
+    /// of its children are
+    class JobSystem {
+    public:
+        struct Job {
+            std::function<void()> work;
+            Job* parent;
+            /// The job itself plus its unfinished children
+            std::atomic<int> unfinished;
+            /// Owners, the job is deleted when the last one lets go
+            std::atomic<int> refs;
         };
 
-        union {
-            KeyEvent keyEvent;
+        JobSystem() = default;
+        ~JobSystem() { Stop(); }
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        /// Spawn the workers, 0 means one thread per hardware thread 
+        /// (the calling thread included). Called by the first Run() if 
+        /// not done before, later calls do nothing
+        void Start(unsigned int threads = 0) {
+            std::call_once(started, [this, threads]() {
+                unsigned int count = threads ? threads : 
+                    std::max(1u, std::thread::hardware_concurrency());
+
+                // Slot 0 is shared by every thread outside the pool
+                queues.reset(new Queue[count]);
+                queueCount = count;
+
+                for (unsigned int i = 1; i < count; i++) {
+                    workers.emplace_back([this, i]() { WorkerLoop(i); });
+                }
+            });
+        }
+
+        /// Join the workers, jobs still queued are not run
+        void Stop() {
+            {
+                std::lock_guard<std::mutex> guard(sleepMtx);
+                quit = true;
+            }
+            wakeUp.notify_all();
+            for (std::thread& worker : workers) worker.join();
+            workers.clear();
+        }
+
+        /// Threads running jobs, callers of Wait() not counted
+        unsigned int Threads() {
+            Start();
+            return queueCount;
+        }
+
+        /// Make a job, not running yet. A job without a parent has to be
+        /// Wait()ed on exactly once, children are waited on through it
+        Job* Create(std::function<void()> work, Job* parent = nullptr) {
+            Job* job = new Job{ std::move(work), parent, {1}, {parent ? 1 : 2} };
+
+            if (parent) {
+                parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+                parent->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+            return job;
+        }
+
+        /// Queue a job on the calling thread's deque
+        void Run(Job* job) {
+            Start();
+            queues[CurrentQueue()].Push(job);
+
+            pending.fetch_add(1, std::memory_order_release);
+            if (sleeping.load(std::memory_order_acquire) > 0) wakeUp.notify_one();
+        }
+
+        /// Shorthand of Create and Run
+        Job* Run(std::function<void()> work, Job* parent = nullptr) {
+            Job* job = Create(std::move(work), parent);
+            Run(job);
+            return job;
+        }
+
+        /// Run other jobs until `job` and all of its children are done,
+        /// the handle is invalid afterwards
+        void Wait(Job* job) {
+            while (job->unfinished.load(std::memory_order_acquire) > 0) {
+                if (!RunOne(CurrentQueue())) std::this_thread::yield();
+            }
+            Release(job);
+        }
+
+        /// Call fn(i) for every i in [begin, end) on all threads, in 
+        /// chunks of at least `grain` items. Returns when all are done
+        template <class Fn>
+        void ParallelFor(size_t begin, size_t end, size_t grain, Fn&& fn) {
+            if (begin >= end) return;
+            grain = std::max<size_t>(grain, 1);
+
+            // A handful of chunks per thread leaves room for stealing 
+            size_t chunks = std::min((end - begin + grain - 1) / grain, 
+                size_t(Threads()) * 4);
+            size_t chunk = (end - begin + chunks - 1) / chunks;
+
+            Job* root = Create([]() {});
+            for (size_t from = begin; from < end; from += chunk) {
+                size_t to = std::min(end, from + chunk);
+                Run([&fn, from, to]() {
+                    for (size_t i = from; i < to; i++) fn(i);
+                }, root);
+            }
+            Run(root);
+            Wait(root);
+        }
+
+    private:
+        /// Deque of a worker, a plain mutex is enough as the owner rarely
+        /// meets a thief on it
+        struct alignas(64) Queue {
+            std::mutex mtx;
+            std::deque<Job*> jobs;
+
+            void Push(Job* job) {
+                std::lock_guard<std::mutex> guard(mtx);
+                jobs.push_back(job);
+            }
+
+            /// Owner side, newest first
+            Job* Pop() {
+                std::lock_guard<std::mutex> guard(mtx);
+                if (jobs.empty()) return nullptr;
+                Job* job = jobs.back();
+                jobs.pop_back();
+                return job;
+            }
+
+            /// Thief side, oldest first
+            Job* Steal() {
+                std::unique_lock<std::mutex> guard(mtx, std::try_to_lock);
+                if (!guard.owns_lock() || jobs.empty()) return nullptr;
+                Job* job = jobs.front();
+                jobs.pop_front();
+                return job;
+            }
         };
 
-        /// Create new empty event object
-        Event() : type(EventType::NONE) {}
-        /// Create a new event of a specific type
-        Event(EventType type) : type(type) {}
+        std::once_flag started;
+        std::unique_ptr<Queue[]> queues;
+        unsigned int queueCount = 0;
+        std::vector<std::thread> workers;
 
-        #ifdef __linux__
-        /// Forge a new event based on XEVENT
-        Event(const XEvent* xevent);
+        /// Jobs queued and not taken yet, idle workers sleep while it's 0
+        std::atomic<int> pending{0};
+        std::atomic<int> sleeping{0};
+        std::mutex sleepMtx;
+        std::condition_variable wakeUp;
+        bool quit = false;
+
+        /// Deque of the calling thread, 0 for threads outside the pool
+        unsigned int CurrentQueue() const {
+            return current.system == this ? current.index : 0;
+        }
+
+        struct Current { const JobSystem* system; unsigned int index; };
+        static inline thread_local Current current{ nullptr, 0 };
+
+        /// Take a job from our deque or steal one, run it. 
+        /// Returns false if there was nothing to do
+        bool RunOne(unsigned int self) {
+            Job* job = queues[self].Pop();
+
+            for (unsigned int i = 1; job == nullptr && i < queueCount; i++) {
+                job = queues[(self + i) % queueCount].Steal();
+            }
+            if (job == nullptr) return false;
+
+            pending.fetch_sub(1, std::memory_order_relaxed);
+            {
+                RPE_PROFILE_SCOPE("Job");
+                job->work();
+            }
+            Finish(job);
+            return true;
+        }
+
+        /// One more part of `job` is done, passes completion up the tree
+        void Finish(Job* job) {
+            if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+            Job* parent = job->parent;
+            Release(job);
+
+            if (parent) {
+                Finish(parent);
+                Release(parent);
+            }
+        }
+
+        void Release(Job* job) {
+            if (job->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete job;
+        }
+
+        void WorkerLoop(unsigned int index) {
+            current = { this, index };
+        #ifdef RPE_PROFILER
+            char name[32];
+            snprintf(name, sizeof(name), "jobs %u", index);
+            RPE_PROFILE_THREAD(name);
         #endif
+
+            for (;;) {
+                if (RunOne(index)) continue;
+
+                std::unique_lock<std::mutex> guard(sleepMtx);
+                if (quit) return;
+
+                // Timed, a wake-up racing the counter costs 1 ms at worst
+                sleeping.fetch_add(1, std::memory_order_acq_rel);
+                wakeUp.wait_for(guard, std::chrono::milliseconds(1), [this]() {
+                    return quit || pending.load(std::memory_order_acquire) > 0;
+                });
+                sleeping.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        }
+    };
+
+    /// Draw calls recorded for later, see TileRasterizer. Sprites are 
+    /// referenced, not copied, and have to stay alive until executed
+    class CommandList {
+    public:
+        struct Command {
+            enum class Type : uint8_t { 
+                CLEAR, FILL_RECT, BLIT, LINE, LINE_AA, ELLIPSE, FILL_ELLIPSE, POLYGON, TEXT
+            } type;
+            BlitMode mode;
+            /// Framebuffer area the command may touch
+            Rect bounds;
+            uint32_t color;
+            const Sprite* sprite;
+            /// Part of the sprite to draw
+            Rect source;
+            /// LINE and LINE_AA end points, ELLIPSE and FILL_ELLIPSE center
+            /// and radii, TEXT position
+            float shape[4] = {};
+            /// POLYGON, its points are Points()[first, first + count).
+            /// TEXT, its spans are Spans()[first, first + count)
+            uint32_t first = 0, count = 0;
+        };
+
+        void Clear(uint32_t color) {
+            Add({ Command::Type::CLEAR, BlitMode::OPAQUE, 
+                Rect::Unbounded(), color, nullptr, {} });
+        }
+
+        void FillRect(int x, int y, int w, int h, uint32_t color) {
+            Add({ Command::Type::FILL_RECT, BlitMode::OPAQUE, 
+                { x, y, w, h }, color, nullptr, {} });
+        }
+
+        void Blit(const Sprite& sprite, int x, int y) {
+            Blit(sprite, x, y, sprite.mode);
+        }
+
+        void Blit(const Sprite& sprite, int x, int y, BlitMode mode) {
+            Rect source = { 0, 0, int(sprite.width), int(sprite.height) };
+            Add({ Command::Type::BLIT, mode, 
+                { x, y, source.width, source.height }, 0, &sprite, source });
+        }
+
+        void DrawLine(int x0, int y0, int x1, int y1, uint32_t color) {
+            Shape(Command::Type::LINE, Framebuffer::LineBounds(x0, y0, x1, y1), 
+                color, float(x0), float(y0), float(x1), float(y1));
+        }
+
+        void DrawLineAA(float x0, float y0, float x1, float y1, uint32_t color) {
+            Shape(Command::Type::LINE_AA, Framebuffer::LineBoundsAA(x0, y0, x1, y1), 
+                color, x0, y0, x1, y1);
+        }
+
+        void DrawEllipse(int cx, int cy, int rx, int ry, uint32_t color) {
+            Shape(Command::Type::ELLIPSE, Framebuffer::EllipseBounds(cx, cy, rx, ry), 
+                color, float(cx), float(cy), float(rx), float(ry));
+        }
+
+        void FillEllipse(int cx, int cy, int rx, int ry, uint32_t color) {
+            Shape(Command::Type::FILL_ELLIPSE, Framebuffer::EllipseBounds(cx, cy, rx, ry), 
+                color, float(cx), float(cy), float(rx), float(ry));
+        }
+
+        void DrawCircle(int cx, int cy, int radius, uint32_t color) {
+            DrawEllipse(cx, cy, radius, radius, color);
+        }
+
+        void FillCircle(int cx, int cy, int radius, uint32_t color) {
+            FillEllipse(cx, cy, radius, radius, color);
+        }
+
+        /// The points are copied
+        void FillPolygon(const Point* points, size_t count, uint32_t color) {
+            Command command = { Command::Type::POLYGON, BlitMode::OPAQUE, 
+                Framebuffer::PolygonBounds(points, count), color, nullptr, {} };
+            command.first = uint32_t(this->points.size());
+            command.count = uint32_t(count);
+            this->points.insert(this->points.end(), points, points + count);
+            Add(command);
+        }
+
+        void FillPolygon(const std::vector<Point>& points, uint32_t color) {
+            FillPolygon(points.data(), points.size(), color);
+        }
+
+        /// The text is laid out (or found in the font's cache) right away
+        /// and its spans copied, the font may change before execution
+        void DrawText(const BitmapFont& font, int x, int y, const char* text, uint32_t color) {
+            const TextRun& run = font.Cached(text);
+            Rect bounds = { x + run.bounds.x, y + run.bounds.y, 
+                run.bounds.width, run.bounds.height };
+
+            Shape(Command::Type::TEXT, bounds, color, float(x), float(y), 0.0f, 0.0f);
+            commands.back().first = uint32_t(spans.size());
+            commands.back().count = uint32_t(run.spans.size());
+            spans.insert(spans.end(), run.spans.begin(), run.spans.end());
+        }
+
+        /// Thread allowed to record, checked by assert() in debug builds.
+        /// The default id lets any thread record
+        std::thread::id recorder;
+
+        /// Forget every command, keeps the memory
+        void Reset() { 
+            commands.clear(); 
+            points.clear();
+            spans.clear();
+        }
+
+        bool Empty() const { return commands.empty(); }
+        size_t Size() const { return commands.size(); }
+        const std::vector<Command>& Commands() const { return commands; }
+        /// Points of the POLYGON commands
+        const std::vector<Point>& Points() const { return points; }
+        /// Spans of the TEXT commands
+        const std::vector<TextRun::Span>& Spans() const { return spans; }
+
+        /// Run one of this list's commands right away, clipped to `clip`
+        void Execute(const Command& command, Framebuffer& target, Rect clip) const {
+            const Rect& r = command.bounds;
+            const float* s = command.shape;
+
+            switch (command.type) {
+            case Command::Type::CLEAR:
+                target.FillRect(clip.x, clip.y, clip.width, clip.height, 
+                    command.color);
+                break;
+            case Command::Type::FILL_RECT:
+                target.FillRect(r.x, r.y, r.width, r.height, command.color, clip);
+                break;
+            case Command::Type::BLIT:
+                target.BlitPart(*command.sprite, command.source, r.x, r.y, 
+                    command.mode, clip);
+                break;
+            case Command::Type::LINE:
+                target.DrawLine(int(s[0]), int(s[1]), int(s[2]), int(s[3]), 
+                    command.color, clip);
+                break;
+            case Command::Type::LINE_AA:
+                target.DrawLineAA(s[0], s[1], s[2], s[3], command.color, clip);
+                break;
+            case Command::Type::ELLIPSE:
+                target.DrawEllipse(int(s[0]), int(s[1]), int(s[2]), int(s[3]), 
+                    command.color, clip);
+                break;
+            case Command::Type::FILL_ELLIPSE:
+                target.FillEllipse(int(s[0]), int(s[1]), int(s[2]), int(s[3]), 
+                    command.color, clip);
+                break;
+            case Command::Type::POLYGON:
+                target.FillPolygon(points.data() + command.first, command.count, 
+                    command.color, clip);
+                break;
+            case Command::Type::TEXT:
+                target.FillSpans(spans.data() + command.first, command.count, 
+                    int(s[0]), int(s[1]), command.color, clip);
+                break;
+            }
+        }
+
+    private:
+        std::vector<Command> commands;
+        std::vector<Point> points;
+        std::vector<TextRun::Span> spans;
+
+        void Add(const Command& command) {
+            assert(recorder == std::thread::id() || recorder == std::this_thread::get_id());
+            commands.push_back(command);
+        }
+
+        void Shape(Command::Type type, Rect bounds, uint32_t color, 
+            float a, float b, float c, float d) {
+            Command command = { type, BlitMode::OPAQUE, bounds, color, nullptr, {} };
+            command.shape[0] = a, command.shape[1] = b;
+            command.shape[2] = c, command.shape[3] = d;
+            Add(command);
+        }
+    };
+
+    /// Executes command lists in parallel. The framebuffer is cut into
+    /// square tiles, each command is binned into every tile it touches 
+    /// and every tile then replays its bin in recording order on one 
+    /// thread. No two threads ever write the same pixel, so there is no
+    /// locking and the result is the same for any number of threads
+    class TileRasterizer {
+    public:
+        static constexpr int tileSize = 64;
+
+        /// Run the commands with the tiles spread over `jobs`
+        void Execute(const CommandList& list, Framebuffer& target, JobSystem& jobs) {
+            if (list.Empty()) return;
+
+            Bin(list, target);
+
+            // Damage is recorded once per command below, not by each tile
+            bool trackDamage = target.trackDamage;
+            target.trackDamage = false;
+
+            const auto& commands = list.Commands();
+            jobs.ParallelFor(0, activeTiles.size(), 1, [&](size_t i) {
+                unsigned int tile = activeTiles[i];
+                Rect clip = TileRect(tile, target);
+
+                for (uint32_t index : bins[tile]) {
+                    list.Execute(commands[index], target, clip);
+                }
+            });
+
+            target.trackDamage = trackDamage;
+            for (const auto& command : commands) target.Damage(command.bounds);
+        }
+
+    private:
+        /// Indices of the commands touching each tile, in order
+        std::vector<std::vector<uint32_t>> bins;
+        /// Tiles with a non-empty bin
+        std::vector<unsigned int> activeTiles;
+        int tilesX = 0, tilesY = 0;
+
+        Rect TileRect(unsigned int tile, const Framebuffer& target) const {
+            Rect rect = { int(tile % tilesX) * tileSize, int(tile / tilesX) * tileSize, 
+                tileSize, tileSize };
+            return rect.Intersect(target.Bounds());
+        }
+
+        void Bin(const CommandList& list, const Framebuffer& target) {
+            tilesX = (int(target.width) + tileSize - 1) / tileSize;
+            tilesY = (int(target.height) + tileSize - 1) / tileSize;
+
+            // Bins keep their memory from frame to frame
+            bins.resize(size_t(tilesX) * tilesY);
+            for (auto& bin : bins) bin.clear();
+
+            const auto& commands = list.Commands();
+            for (uint32_t index = 0; index < commands.size(); index++) {
+                Rect area = commands[index].bounds.Intersect(target.Bounds());
+                if (area.Empty()) continue;
+
+                int tx0 = area.x / tileSize, tx1 = (area.x + area.width - 1) / tileSize;
+                int ty0 = area.y / tileSize, ty1 = (area.y + area.height - 1) / tileSize;
+
+                for (int ty = ty0; ty <= ty1; ty++) {
+                    for (int tx = tx0; tx <= tx1; tx++) {
+                        bins[size_t(ty) * tilesX + tx].push_back(index);
+                    }
+                }
+            }
+
+            activeTiles.clear();
+            for (unsigned int tile = 0; tile < bins.size(); tile++) {
+                if (!bins[tile].empty()) activeTiles.push_back(tile);
+            }
+        }
+    };
+
+    /// Keeps frames on a steady cadence. Waits by sleeping most of the way
+    /// to the deadline and spinning the rest, the OS scheduler alone is too
+    /// coarse for sub-millisecond accuracy
+    class FramePacer {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /// Start measuring from now
+        void Reset() {
+            lastFrame = deadline = Clock::now();
+        }
+
+        /// Mark the start of a new frame, returns the seconds since the 
+        /// previous one
+        double Tick() {
+            Clock::time_point now = Clock::now();
+            double delta = std::chrono::duration<double>(now - lastFrame).count();
+            lastFrame = now;
+            return delta;
+        }
+
+        /// Block until the next frame is due for the given frame rate.
+        /// The last `spinMargin` seconds before the deadline are spun away
+        /// instead of slept. A non positive frame rate returns right away
+        void Wait(double targetFps, double spinMargin) {
+            if (targetFps <= 0.0) return;
+
+            auto period = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(1.0 / targetFps));
+            auto margin = std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(spinMargin));
+
+            deadline += period;
+            Clock::time_point now = Clock::now();
+
+            // Fell behind by more than a frame, don't try to catch up with 
+            // a burst of short frames, start over from here
+            if (deadline + period < now) {
+                deadline = now;
+                return;
+            }
+
+            if (deadline - now > margin) {
+                std::this_thread::sleep_until(deadline - margin);
+            }
+
+            while (Clock::now() < deadline) {
+                std::this_thread::yield();
+            }
+        }
+
+    private:
+        Clock::time_point lastFrame, deadline;
+    };
+
+    /// Rolling statistics over the last `window` frames: a frame time 
+    /// histogram with percentiles, missed deadlines and the time each 
+    /// stage of the main loop took. Fixed size, recording a frame is a 
+    /// handful of additions and never allocates, queries do the work. 
+    /// Filled and read on the engine thread (OnUpdate)
+    class FrameStats {
+    public:
+        /// Parts of a frame on the engine thread. In pipelined mode RENDER
+        /// and PRESENT are the render thread's, one frame behind, and 
+        /// RENDER_WAIT is the engine thread waiting for it
+        enum class Stage : uint8_t {
+            POLL = 0,
+            FIXED_UPDATE = 1,
+            UPDATE = 2,
+            RENDER = 3,
+            PRESENT = 4,
+            RENDER_WAIT = 5,
+            /// Idle mode sleep and frame pacing
+            WAIT = 6,
+            COUNT = 7,
+        };
+        static constexpr size_t stageCount = size_t(Stage::COUNT);
+
+        /// Frames the statistics are taken over
+        static constexpr size_t window = 512;
+        /// Histogram bins are log-spaced, 16 per doubling (~4.4% wide), 
+        /// from 1 us up to ~1 s; longer frames land in the last bin
+        static constexpr int binsPerOctave = 16;
+        static constexpr int binCount = binsPerOctave * 20;
+
+        /// Record a frame of `frameTime` seconds. It missed its deadline 
+        /// if it took over 1.5 `deadline`s, i.e. a whole refresh late; 
+        /// 0 means no deadline
+        void AddFrame(double frameTime, double deadline, const double (&stages)[stageCount]) {
+            if (count == window) Evict(samples[next]);
+            else count++;
+
+            Sample& sample = samples[next];
+            next = (next + 1) % window;
+
+            sample.frame = frameTime;
+            sample.bin = uint16_t(BinOf(frameTime));
+            sample.missed = deadline > 0.0 && frameTime > deadline * 1.5;
+            std::copy(stages, stages + stageCount, sample.stages);
+
+            histogram[sample.bin]++;
+            frameSum += frameTime;
+            for (size_t i = 0; i < stageCount; i++) stageSums[i] += stages[i];
+            missed += sample.missed;
+            totalMissed += sample.missed;
+            totalFrames++;
+        }
+
+        /// Frames in the window
+        size_t Count() const { return count; }
+        /// Frames missing their deadline in the window, and ever
+        unsigned int Missed() const { return missed; }
+        uint64_t TotalMissed() const { return totalMissed; }
+        uint64_t TotalFrames() const { return totalFrames; }
+
+        double Mean() const { return count ? frameSum / count : 0.0; }
+
+        double Max() const {
+            double max = 0.0;
+            for (size_t i = 0; i < count; i++) max = std::max(max, samples[i].frame);
+            return max;
+        }
+
+        /// Frame time `fraction` (0.5, 0.95, 0.99...) of the frames stay 
+        /// within, to the resolution of the histogram
+        double Percentile(double fraction) const {
+            if (count == 0) return 0.0;
+
+            size_t target = std::max<size_t>(1, size_t(std::ceil(fraction * count)));
+            size_t seen = 0;
+            for (int bin = 0; bin < binCount; bin++) {
+                seen += histogram[bin];
+                if (seen >= target) return std::min(BinEnd(bin), Max());
+            }
+            return Max();
+        }
+
+        struct StageTime {
+            double last, mean, max;
+        };
+
+        /// Seconds a stage took, in the latest frame and over the window
+        StageTime Time(Stage stage) const {
+            size_t index = size_t(stage);
+            StageTime time = { 0.0, count ? stageSums[index] / count : 0.0, 0.0 };
+            if (count == 0) return time;
+
+            time.last = samples[(next + window - 1) % window].stages[index];
+            for (size_t i = 0; i < count; i++) {
+                time.max = std::max(time.max, samples[i].stages[index]);
+            }
+            return time;
+        }
+
+        /// Frames of the window in a histogram bin, spanning BinStart(bin)
+        /// to BinEnd(bin) seconds
+        uint32_t Bin(int bin) const { return histogram[bin]; }
+        static double BinStart(int bin) { return std::exp2(double(bin) / binsPerOctave) * 1e-6; }
+        static double BinEnd(int bin) { return BinStart(bin + 1); }
+
+        /// Forget the window, totals included
+        void Reset() { *this = FrameStats(); }
+
+    private:
+        struct Sample {
+            double frame;
+            double stages[stageCount];
+            uint16_t bin;
+            bool missed;
+        };
+
+        Sample samples[window] = {};
+        size_t next = 0, count = 0;
+        uint32_t histogram[binCount] = {};
+        double frameSum = 0.0, stageSums[stageCount] = {};
+        unsigned int missed = 0;
+        uint64_t totalMissed = 0, totalFrames = 0;
+
+        static int BinOf(double seconds) {
+            double micros = seconds * 1e6;
+            if (micros <= 1.0) return 0;
+            return std::min(binCount - 1, int(std::log2(micros) * binsPerOctave));
+        }
+
+        void Evict(const Sample& sample) {
+            histogram[sample.bin]--;
+            frameSum -= sample.frame;
+            for (size_t i = 0; i < stageCount; i++) stageSums[i] -= sample.stages[i];
+            missed -= sample.missed;
+        }
+    };
+
+    /// Base of statically dispatched handlers. Derive from it and hide the 
+    /// hooks you care about, the rest stay empty and compile away.
+    /// Hooks are resolved at compile time, so unlike `callbacks` they are
+    /// free to inline into the engine loop
+    struct EventHandler {
+        /// Fires just when any window event happens
+        void OnEvent(const Event&) {}
+        /// Fires when a key is pressed, guaranteed to be Event::KeyEvent 
+        void OnKey(const Event&) {}
+        /// Fires on pointer motion, buttons and wheel, guaranteed to be 
+        /// Event::MouseEvent
+        void OnMouse(const Event&) {}
+        /// Fires when the application has just started, but initialized
+        void OnBegin() {}
+        /// Fires when the application is done
+        void OnEnd() {}
+        /// Fires every config.fixedTimestep seconds of game time
+        void OnFixedUpdate(double) {}
+        /// Fires once per frame with the seconds since the previous one
+        void OnUpdate(double) {}
+        /// Fires once per frame to draw, right before presentation
+        void OnRender(Framebuffer&) {}
     };
 
+    /// Where the window lives
+    enum class Backend : uint8_t {
+        /// X11 if a server is reachable, HEADLESS otherwise
+        AUTO = 0,
+        /// Real window on an X server, fails hard without one
+        X11 = 1,
+        /// No window at all, frames stay in memory and input comes only
+        /// from Platform::PushEvent. Meant for CI, benchmarks and servers
+        HEADLESS = 2,
+    };
 
     class Platform {
     protected:
@@ -79,19 +3434,137 @@ namespace rpe {
             unsigned int width = 256, 
             unsigned int height = 256,
             const char* title = "RapturePixelEngine Window");
-        /// Make graphics and initialize GL context
-        void CreateGraphics();
+        /// Make the presentation surface for a width x height framebuffer, 
+        /// shared with the X server if possible. Every framebuffer pixel 
+        /// becomes a `scale` x `scale` square of the window
+        void CreateGraphics(unsigned int width, unsigned int height, 
+            unsigned int scale = 1);
+        /// Release the presentation surface
+        void DestroyGraphics();
+        /// CreateGraphics on a present thread of its own, with its own 
+        /// connection to the X server. Frames then go through 
+        /// swapChain.Submit() instead of Present()
+        void CreateSwapChain(unsigned int depth, const Framebuffer&, 
+            unsigned int scale = 1);
+        /// Present what is still queued, then DestroyGraphics on the 
+        /// present thread and end it
+        void DestroySwapChain();
+        /// Put the framebuffer on the screen
+        void Present(const Framebuffer&);
         /// Show the window 
         void ShowWindow();
         /// Process all the incoming events in the library requires so
         void PollEvents(rpe::RapturePixelEngine*);
+        /// Same as above, events go straight to a static handler
+        template <class Handler>
+        void PollEvents(rpe::RapturePixelEngine*, Handler&);
+        /// Sleep until an event arrives, Wake() is called or the timeout
+        /// (in seconds, negative waits forever) runs out.
+        /// Returns false if it timed out
+        bool WaitEvents(double timeout = -1.0);
+        /// Interrupt WaitEvents from any thread
+        void Wake();
         /// Set the window title
         void SetWindowTitle(const char*);
+        /// Keycode of the key that types a symbol (an X KeySym such as 
+        /// XK_space), 0 if there is none or no X server
+        uint8_t KeyCode(unsigned long keysym);
+        /// Queue a synthetic event, handed out by PollEvents before any
+        /// window system events. Safe to call from any thread
+        void PushEvent(const Event&);
+
+        /// Backend to use, resolved by CreateWindow when left on AUTO.
+        /// Atomic, Wake() reads it from any thread
+        std::atomic<Backend> backend{ Backend::AUTO };
+        /// Number of frames presented so far
+        std::atomic<uint64_t> presentedFrames{ 0 };
+        /// Frames on their way to the present thread, see CreateSwapChain
+        SwapChain swapChain;
+        /// Set when Xlib is used from more than one thread
+        bool threaded = false;
+        /// Window pixels per framebuffer pixel side, set by CreateGraphics
+        unsigned int scale = 1;
+        /// Drain input without dispatching it, the engine replays a log
+        bool discardInput = false;
 
     private:
+        /// Synthetic events waiting for PollEvents
+        std::deque<Event> syntheticEvents;
+        std::mutex syntheticMtx;
+        /// Headless WaitEvents sleeps on this one
+        std::condition_variable syntheticSignal;
+        bool woken = false;
+
+        /// Hand out up to `cap` (0 is unlimited) synthetic events,
+        /// returns how many were dispatched
+        template <class Handler>
+        unsigned int PollSyntheticEvents(rpe::RapturePixelEngine*, Handler&, 
+            unsigned int cap);
+
     #ifdef __linux__
         Display* d;
+        /// Connection the presentation goes through, `d` unless a swap 
+        /// chain presents from its own thread
+        Display* pd = nullptr;
         Window w;
+        GC gc = nullptr;
+        /// Written by Wake() (from any thread) to interrupt WaitEvents
+        std::atomic<int> wakeFd{ -1 };
+
+        /// Image the framebuffer is copied into before presentation
+        XImage* image = nullptr;
+        /// Shared memory segment backing `image` if MIT-SHM is in use
+        XShmSegmentInfo shmInfo{};
+        bool useShm = false;
+        /// XShmPutImage was issued and the server did not complete it yet
+        bool shmPending = false;
+        int shmCompletionType = -1;
+        /// Scratch list of rectangles sent by Present
+        std::vector<Rect> presentRects;
+        /// Framebuffer rows to the pixel layout of the X visual, picked 
+        /// by CreateGraphics, null if the visual is not supported
+        void (*convertRow)(char* dst, const uint32_t* src, size_t count) = nullptr;
+        /// The visual is the framebuffer layout, rows are plain copies
+        bool nativeVisual = false;
+        /// Scratch rows of palette expanded and upscaled pixels
+        std::vector<uint32_t> presentRow, presentWide;
+
+        template <class Format>
+        static void ConvertToVisual(char* dst, const uint32_t* src, size_t count) {
+            format::ConvertRow<Format, format::BGRA8888>(
+                (typename Format::Pixel*)dst, src, count);
+        }
+        /// Exposed window areas waiting to be presented again
+        std::vector<Rect> exposed;
+        std::mutex exposedMtx;
+
+        /// Everything the window listens to
+        static constexpr long eventMask = ExposureMask | KeyPressMask | 
+            KeyReleaseMask | PointerMotionMask | ButtonPressMask | ButtonReleaseMask;
+        /// Last pointer position in window pixels, for motion deltas
+        int pointerX = 0, pointerY = 0;
+        bool pointerKnown = false;
+
+        /// Window to framebuffer coordinates of a mouse event, motion 
+        /// also gets its delta
+        void ToFramebufferPixels(Event& event) {
+            Event::MouseEvent& mouse = event.mouseEvent;
+
+            if (event.type == Event::EventType::MOUSE_MOVE) {
+                if (pointerKnown) mouse.dx = mouse.x - pointerX, mouse.dy = mouse.y - pointerY;
+                pointerX = mouse.x, pointerY = mouse.y;
+                pointerKnown = true;
+            }
+
+            mouse.x /= int(scale), mouse.y /= int(scale);
+        }
+
+        /// Have an exposed area shown again by the next Present, straight
+        /// from the image, the framebuffer is not involved
+        void QueueExposed(const XExposeEvent& expose) {
+            std::lock_guard<std::mutex> guard(exposedMtx);
+            exposed.push_back({ expose.x, expose.y, expose.width, expose.height });
+        }
     #endif
     };
 
@@ -107,10 +3580,85 @@ namespace rpe {
         Platform* platform = nullptr;
 
         int x, y;
+        /// Framebuffer (logical) size, the window is `scale` times larger
         unsigned int width, height;
+        unsigned int scale = 1;
         const char* title;
 
-        double deltaTime;
+        double deltaTime = 0.0;
+        /// How far (0..1) the current frame is between two fixed updates,
+        /// meant for interpolating what is drawn
+        double fixedAlpha = 0.0;
+
+        /// Pixels to be shown on the next frame
+        Framebuffer framebuffer;
+        /// Draw calls recorded during the frame, executed on all cores by
+        /// `rasterizer` right after OnRender. In pipelined mode record only
+        /// from OnRender, OnUpdate runs alongside the execution (asserted
+        /// in debug builds)
+        CommandList commands;
+        /// Runs `commands`
+        TileRasterizer rasterizer;
+        /// Shared by the rasterizer and anyone else with parallel work, so
+        /// thread pools don't fight over the cores. Call jobs.Start(n) 
+        /// before Construct() to pick the number of threads
+        JobSystem jobs;
+
+        struct {
+            /// Handle every queued event each frame instead of just one
+            bool batchEvents = true;
+            /// Upper bound of events handled per frame in batched mode, 
+            /// leftovers wait for the next frame. 0 means no limit
+            unsigned int maxEventsPerFrame = 256;
+            /// Sleep between frames until an event comes in or a frame is
+            /// requested through RequestFrame(), instead of spinning
+            bool idle = false;
+            /// In idle mode, longest sleep (in seconds) before a frame is
+            /// made anyway. Negative sleeps until something happens
+            double idleTimeout = -1.0;
+            /// Window system backend, see rpe::Backend
+            Backend backend = Backend::AUTO;
+            /// Also put every event into `eventRing` for another thread 
+            /// to drain
+            bool eventRing = false;
+            /// Run OnRender and presentation of a frame on a second thread,
+            /// while the engine thread already updates the next one.
+            /// Share state between the two through DoubleBuffered
+            bool pipelined = false;
+            /// Frames per second to hold the main loop at, 0 runs unbounded
+            double targetFps = 0.0;
+            /// Seconds spun (instead of slept) before each frame deadline,
+            /// trades CPU time for steadier frame times
+            double spinMargin = 0.001;
+            /// Step in seconds of OnFixedUpdate, 0 disables fixed updates
+            double fixedTimestep = 0.0;
+            /// Most fixed updates run in one frame, the rest of the
+            /// backlog is dropped so a slow frame can't snowball
+            unsigned int maxFixedSteps = 8;
+            /// Record every frame's deltaTime and events to this file
+            const char* recordInput = nullptr;
+            /// Replay a file written through recordInput instead of live 
+            /// input, deltaTime included. The engine stops at its end
+            const char* replayInput = nullptr;
+            /// Framebuffers in flight. 1 presents right after rendering, 
+            /// 2 or 3 hand finished frames to a present thread and start on
+            /// the next one at once, only blocking while all are in flight
+            unsigned int swapChain = 1;
+        } config;
+
+        /// Keys held, pressed and released as of this frame
+        InputState input;
+        /// Input being recorded or replayed, see config.recordInput
+        InputLog inputLog;
+        /// Frame time percentiles, missed deadlines and stage timings of 
+        /// the recent frames. Deadlines are 1 / config.targetFps, or 60 Hz
+        /// when unbounded
+        FrameStats frameStats;
+
+        /// Events for a user thread to consume at its own pace, filled
+        /// on the engine thread when config.eventRing is set. Exactly one
+        /// thread may Pop from it
+        SpscRing<Event, 1024> eventRing;
 
         struct {
             /// Fires just when any window event happens
@@ -121,8 +3669,33 @@ namespace rpe {
             std::function<void()> OnEnd = []() {};
             /// Fires when a key is pressed, guaranteed to be Event::KeyEvent 
             std::function<void(const Event&)> OnKey = OnEventCallback;
+            /// Fires on pointer motion, buttons and wheel, guaranteed to 
+            /// be Event::MouseEvent
+            std::function<void(const Event&)> OnMouse = [](const Event&) {};
+            /// Fires every config.fixedTimestep seconds of game time, 
+            /// receives the step
+            std::function<void(double)> OnFixedUpdate = [](double) {};
+            /// Fires once per frame, receives deltaTime
+            std::function<void(double)> OnUpdate = [](double) {};
+            /// Fires once per frame to draw into the framebuffer
+            std::function<void(Framebuffer&)> OnRender = [](Framebuffer&) {};
         } callbacks;
 
+        /// Forwards the static hooks to `callbacks`, used when Construct() 
+        /// gets no handler of its own
+        struct DynamicHandler : EventHandler {
+            RapturePixelEngine* engine;
+
+            void OnEvent(const Event& e) { engine->callbacks.OnEventCallback(e); }
+            void OnKey(const Event& e) { engine->callbacks.OnKey(e); }
+            void OnMouse(const Event& e) { engine->callbacks.OnMouse(e); }
+            void OnBegin() { engine->callbacks.OnBegin(); }
+            void OnEnd() { engine->callbacks.OnEnd(); }
+            void OnFixedUpdate(double step) { engine->callbacks.OnFixedUpdate(step); }
+            void OnUpdate(double delta) { engine->callbacks.OnUpdate(delta); }
+            void OnRender(Framebuffer& fb) { engine->callbacks.OnRender(fb); }
+        } dynamicHandler{ {}, this };
+
         // Get the only RapturePixelEngine instance
         static inline RapturePixelEngine* instance() {
             static RapturePixelEngine engine;
@@ -140,26 +3713,92 @@ namespace rpe {
             platform->SetWindowTitle(title);       
         }
 
+        /// Draw a sprite onto the framebuffer in its own mode
+        void Blit(const Sprite& sprite, int x, int y) {
+            framebuffer.Blit(sprite, x, y);
+        }
+
+        /// Draw a sprite onto the framebuffer
+        void Blit(const Sprite& sprite, int x, int y, BlitMode mode) {
+            framebuffer.Blit(sprite, x, y, mode);
+        }
+
+        /// Route an event to the matching hooks of a handler
+        template <class Handler>
+        void DispatchEvent(Handler& handler, const Event& event) {
+            if (inputLog.Recording()) inputLog.WriteEvent(event);
+            input.Apply(event);
+            if (config.eventRing) eventRing.Push(event);
+            if (event.type == Event::EventType::KEY) handler.OnKey(event);
+            if (event.IsMouse()) handler.OnMouse(event);
+            handler.OnEvent(event);
+        }
+
+        /// Route an event to the matching callbacks
+        void DispatchEvent(const Event& event) {
+            DispatchEvent(dynamicHandler, event);
+        }
+
+        void Construct(
+            int x = 16, 
+            int y = 16, 
+            unsigned int width = 256, 
+            unsigned int height = 256,
+            const char* title = "RapturePixelEngine Window",
+            unsigned int scale = 1,
+            PixelMode pixelMode = PixelMode::RGBA32) {
+            
+            Construct(dynamicHandler, x, y, width, height, title, scale, pixelMode);
+        }
+
+        /// Construct with a statically dispatched handler (see EventHandler)
+        /// in place of `callbacks`. The handler has to outlive the engine 
+        /// thread
+        template <class Handler, class = std::enable_if_t<
+            std::is_base_of<EventHandler, Handler>::value>>
         void Construct(
+            Handler& handler,
             int x = 16, 
             int y = 16, 
             unsigned int width = 256, 
             unsigned int height = 256,
-            const char* title = "RapturePixelEngine Window") {
+            const char* title = "RapturePixelEngine Window",
+            unsigned int scale = 1,
+            PixelMode pixelMode = PixelMode::RGBA32) {
             
             this->x = x, this->y = y, this->width = width, this->height = height,
-            this->title = title;
+            this->title = title, this->scale = std::max(scale, 1u);
+
+            framebuffer.Resize(width, height, pixelMode);
 
-            theThread = std::thread([]() { TheThread(); });
+            theThread = std::thread([&handler]() { TheThread(handler); });
         }
 
         void Start(bool join) {
-            isRunning = true;
+            {
+                std::lock_guard<std::mutex> guard(mtx);
+                isRunning = true;
+            }
+            lock.notify_all();
             if (join) {
                 theThread.join();
             }
         }
 
+        /// Leave the main loop after the current frame, may be called
+        /// from any thread
+        void Stop() {
+            isRunning = false;
+            platform->Wake();
+        }
+
+        /// Make a frame as soon as possible in idle mode, may be called 
+        /// from any thread
+        void RequestFrame() {
+            frameRequested = true;
+            platform->Wake();
+        }
+
         /// Mutex lock for thread safety
         std::mutex mtx;
         /// Lock to prevent changes
@@ -168,22 +3807,137 @@ namespace rpe {
         std::atomic_bool isRunning{false};
         /// Main Engine thread
         std::thread theThread;
+        /// Set by RequestFrame(), consumed by the idle main loop
+        std::atomic_bool frameRequested{false};
+        /// Main loop timing
+        FramePacer pacer;
+        /// Game time not yet consumed by OnFixedUpdate
+        double fixedAccumulator = 0.0;
+
+        /// Frame being updated, see DoubleBuffered
+        uint64_t updateFrame = 0;
+        /// Frame being rendered, see DoubleBuffered
+        uint64_t renderFrame = 0;
+
+        /// Pipelined mode render thread and its handoff
+        std::thread renderThread;
+        std::mutex pipelineMtx;
+        std::condition_variable pipelineSignal;
+        bool renderPending = false;
+        /// Seconds the latest RenderFrame spent rendering and presenting
+        double renderTime = 0.0, presentTime = 0.0;
+        bool renderQuit = false;
+
+        /// Draw and show the frame `renderFrame`
+        template <class Handler>
+        void RenderFrame(Handler& handler) {
+            auto start = FramePacer::Clock::now();
+            {
+                RPE_PROFILE_SCOPE("Render");
+                handler.OnRender(framebuffer);
+            }
+            {
+                RPE_PROFILE_SCOPE("Rasterize");
+                rasterizer.Execute(commands, framebuffer, jobs);
+            }
+            commands.Reset();
+
+            auto rendered = FramePacer::Clock::now();
+            if (platform->swapChain.Active()) {
+                platform->swapChain.Submit(framebuffer);
+            } else {
+                platform->Present(framebuffer);
+            }
+            framebuffer.ClearDamage();
+
+            renderTime = std::chrono::duration<double>(rendered - start).count();
+            presentTime = std::chrono::duration<double>(
+                FramePacer::Clock::now() - rendered).count();
+        }
+
+        /// Pipelined mode, block until the render thread is done with 
+        /// its frame
+        void WaitForRender() {
+            RPE_PROFILE_SCOPE("WaitForRender");
+            std::unique_lock<std::mutex> guard(pipelineMtx);
+            pipelineSignal.wait(guard, [this]() { return !renderPending; });
+        }
+
+        /// Pipelined mode, hand `updateFrame` over to the render thread 
+        /// and move on to the next one. The previous frame has to be done
+        void KickRender() {
+            {
+                std::lock_guard<std::mutex> guard(pipelineMtx);
+                renderFrame = updateFrame++;
+                renderPending = true;
+            }
+            pipelineSignal.notify_all();
+        }
+
+        template <class Handler>
+        static void RenderThread(Handler& handler) {
+            auto instance = RapturePixelEngine::instance();
+            std::unique_lock<std::mutex> guard(instance->pipelineMtx);
+            RPE_PROFILE_THREAD("render");
+
+            for (;;) {
+                instance->pipelineSignal.wait(guard, [instance]() {
+                    return instance->renderPending || instance->renderQuit;
+                });
+                if (!instance->renderPending) break;
+
+                guard.unlock();
+                instance->RenderFrame(handler);
+                guard.lock();
+
+                instance->renderPending = false;
+                instance->pipelineSignal.notify_all();
+            }
+        }
+
+        /// Run as many fixed updates as the elapsed time asks for
+        template <class Handler>
+        void RunFixedUpdates(Handler& handler) {
+            double step = config.fixedTimestep;
+            if (step <= 0.0) return;
+
+            fixedAccumulator += deltaTime;
+
+            unsigned int steps = 0;
+            while (fixedAccumulator >= step && steps < config.maxFixedSteps) {
+                handler.OnFixedUpdate(step);
+                fixedAccumulator -= step;
+                steps++;
+            }
+
+            if (fixedAccumulator >= step) fixedAccumulator = std::fmod(fixedAccumulator, step);
+            fixedAlpha = fixedAccumulator / step;
+        }
 
-        static void TheThread() {
+        template <class Handler>
+        static void TheThread(Handler& handler) {
             // Instance reference
             auto instance = RapturePixelEngine::instance();
             auto platform = instance->platform;
 
-            std::chrono::steady_clock::time_point lastFrameTime, currentFrameTime;
-            
+            RPE_PROFILE_THREAD("engine");
+
             // Creation has to be called here, so the thread recieves control
+            platform->backend = instance->config.backend;
+            bool swapped = instance->config.swapChain > 1;
+            platform->threaded = instance->config.pipelined || swapped;
             platform->CreateWindow(
                 instance->x, 
                 instance->y, 
-                instance->width, 
-                instance->height, 
+                instance->width * instance->scale, 
+                instance->height * instance->scale, 
                 instance->title);
-            platform->CreateGraphics();
+            if (swapped) {
+                platform->CreateSwapChain(instance->config.swapChain, 
+                    instance->framebuffer, instance->scale);
+            } else {
+                platform->CreateGraphics(instance->width, instance->height, instance->scale);
+            }
 
             platform->ShowWindow();
 
@@ -199,24 +3953,194 @@ namespace rpe {
             lock.unlock();
             instance->lock.notify_all();
                 
-            instance->callbacks.OnBegin();
+            if (instance->config.replayInput != nullptr) {
+                if (!instance->inputLog.Replay(instance->config.replayInput)) {
+                    printf("Can't replay input from %s.\n", instance->config.replayInput);
+                }
+            } else if (instance->config.recordInput != nullptr) {
+                if (!instance->inputLog.Record(instance->config.recordInput)) {
+                    printf("Can't record input to %s.\n", instance->config.recordInput);
+                }
+            }
+            platform->discardInput = instance->inputLog.Replaying();
+
+            handler.OnBegin();
+            instance->pacer.Reset();
+
+            bool pipelined = instance->config.pipelined;
+            if (pipelined) {
+                instance->renderQuit = false;
+                instance->renderThread = std::thread([&handler]() { 
+                    RenderThread(handler); 
+                });
+                // Executed and reset on the render thread, so that's the 
+                // only one allowed to record (from OnRender)
+                instance->commands.recorder = instance->renderThread.get_id();
+            }
 
             // Main loop, everything happens here
             // All roads lead to ~~Rome~~ for(;;)
 
-            for(;;) {
-                using namespace std::chrono; 
+            // Stage times of the frame in progress, recorded into 
+            // frameStats once the next Tick() knows how long it took
+            using Stage = FrameStats::Stage;
+            double stages[FrameStats::stageCount] = {};
+            double deadline = 0.0;
+            bool first = true;
+            auto lapStart = FramePacer::Clock::now();
+            auto lap = [&](Stage stage) {
+                auto now = FramePacer::Clock::now();
+                stages[size_t(stage)] = std::chrono::duration<double>(now - lapStart).count();
+                lapStart = now;
+            };
+
+            while(instance->isRunning) {
+                RPE_PROFILE_SCOPE("Frame");
+
                 // Time delta calculation
-                currentFrameTime = steady_clock::now();
-                instance->deltaTime = duration_cast<duration<double>>(
-                        currentFrameTime - lastFrameTime).count();
-                lastFrameTime = currentFrameTime;
+                instance->deltaTime = instance->pacer.Tick();
+                if (!first) instance->frameStats.AddFrame(instance->deltaTime, deadline, stages);
+                first = false;
+                lapStart = FramePacer::Clock::now();
+
+                // A replayed frame lasts what it did when recorded
+                InputLog& log = instance->inputLog;
+                if (log.Replaying() && !log.ReadFrame(instance->deltaTime)) {
+                    instance->isRunning = false;
+                    break;
+                }
+                if (log.Recording()) log.WriteFrame(instance->deltaTime);
                 
-                platform->PollEvents(instance);
+                {
+                    RPE_PROFILE_SCOPE("PollEvents");
+                    instance->input.NewFrame();
+                    platform->PollEvents(instance, handler);
+                    if (log.Replaying()) {
+                        log.ReadEvents([&](const Event& event) { 
+                            instance->DispatchEvent(handler, event); 
+                        });
+                    }
+                }
+                lap(Stage::POLL);
+                {
+                    RPE_PROFILE_SCOPE("FixedUpdate");
+                    instance->RunFixedUpdates(handler);
+                }
+                lap(Stage::FIXED_UPDATE);
+                {
+                    RPE_PROFILE_SCOPE("Update");
+                    handler.OnUpdate(instance->deltaTime);
+                }
+                lap(Stage::UPDATE);
+
+                if (pipelined) {
+                    // Frame N+1 is updated, wait for N to be on the screen
+                    instance->WaitForRender();
+                    lap(Stage::RENDER_WAIT);
+                    stages[size_t(Stage::RENDER)] = instance->renderTime;
+                    stages[size_t(Stage::PRESENT)] = instance->presentTime;
+                    instance->KickRender();
+                } else {
+                    instance->renderFrame = instance->updateFrame;
+                    instance->RenderFrame(handler);
+                    instance->updateFrame++;
+                    lapStart = FramePacer::Clock::now();
+                    stages[size_t(Stage::RENDER)] = instance->renderTime;
+                    stages[size_t(Stage::PRESENT)] = instance->presentTime;
+                }
+
+                // Idle frames are meant to be long, no deadline to miss
+                deadline = instance->config.targetFps > 0.0 ? 
+                    1.0 / instance->config.targetFps : 1.0 / 60.0;
+
+                // Nothing to animate, give the core away until poked. A 
+                // replay has its next frame's input ready, never idles
+                if (instance->config.idle && !log.Replaying() && 
+                    !instance->frameRequested.exchange(false)) {
+                    // The render thread presents through the same Display, 
+                    // its XSync could queue input between the check for 
+                    // queued events and the poll that follows
+                    if (pipelined) instance->WaitForRender();
+                    RPE_PROFILE_SCOPE("Idle");
+                    platform->WaitEvents(instance->config.idleTimeout);
+                    deadline = 0.0;
+                }
+
+                {
+                    RPE_PROFILE_SCOPE("Pace");
+                    instance->pacer.Wait(instance->config.targetFps, 
+                        instance->config.spinMargin);
+                }
+                lap(Stage::WAIT);
+
+                RPE_PROFILE_COLLECT();
+            }
+
+            if (pipelined) {
+                instance->WaitForRender();
+                {
+                    std::lock_guard<std::mutex> guard(instance->pipelineMtx);
+                    instance->renderQuit = true;
+                }
+                instance->pipelineSignal.notify_all();
+                instance->renderThread.join();
+                instance->commands.recorder = std::thread::id();
+            }
+
+            handler.OnEnd();
+            instance->inputLog.Close();
+            platform->discardInput = false;
+            if (swapped) {
+                platform->DestroySwapChain();
+            } else {
+                platform->DestroyGraphics();
+            }
+        }
+    };
+
+    /// Two copies of some state, so that in pipelined mode OnUpdate can 
+    /// write the next frame while OnRender reads the current one. 
+    /// Write() only from the update side (the engine thread), Read() from 
+    /// OnRender. The first Write() of a frame starts from a copy of the
+    /// previous frame
+    template <class T>
+    class DoubleBuffered {
+    public:
+        /// State of the frame being updated
+        T& Write() {
+            auto engine = RapturePixelEngine::instance();
+            uint64_t current = state.load(std::memory_order_relaxed);
+            unsigned int slot = current & 1;
+
+            if (written && (current >> 1) == engine->updateFrame) return slots[slot];
+
+            // Last written frame is complete, it's the renderer's now
+            if (written) {
+                slots[slot ^ 1] = slots[slot];
+                slot ^= 1;
             }
 
-            instance->callbacks.OnEnd();
+            written = true;
+            state.store((engine->updateFrame << 1) | slot, std::memory_order_release);
+            return slots[slot];
+        }
+
+        /// State of the frame being rendered
+        const T& Read() const {
+            auto engine = RapturePixelEngine::instance();
+            uint64_t current = state.load(std::memory_order_acquire);
+            unsigned int slot = current & 1;
+
+            // Written ahead by the update of the next frame
+            if ((current >> 1) > engine->renderFrame) slot ^= 1;
+            return slots[slot];
         }
+
+    private:
+        T slots[2]{};
+        /// Frame of the last Write() shifted left once, its slot in bit 0
+        std::atomic<uint64_t> state{0};
+        bool written = false;
     };
     #pragma endregion // CLASSES AND STRUCTS 
 
@@ -228,6 +4152,66 @@ namespace rpe {
 // ------------------------------ 
 #pragma region METHOD IMPLEMENTATIONS
 #ifdef __linux__
+namespace rpe {
+    /// Set by TrapXErrors() while an X request that may fail is checked
+    inline bool xErrorCaught = false;
+
+    inline int TrapXErrors(Display*, XErrorEvent*) {
+        xErrorCaught = true;
+        return 0;
+    }
+
+    /// Release of a wheel "button", its press already was the whole step
+    inline bool IsWheelRelease(const XEvent& xevent) {
+        return xevent.type == ButtonRelease && 
+            xevent.xbutton.button >= 4 && xevent.xbutton.button <= 7;
+    }
+}
+
+rpe::Event::Event(const XEvent* xevent) : type(EventType::NONE) {
+    switch (xevent->type)
+    {
+    case KeyPress:
+        type = EventType::KEY;
+        keyEvent.type = KeyEventType::PRESS;
+        keyEvent.keycode = uint8_t(xevent->xkey.keycode);
+        break;
+    case KeyRelease:
+        type = EventType::KEY;
+        keyEvent.type = KeyEventType::RELEASE;
+        keyEvent.keycode = uint8_t(xevent->xkey.keycode);
+        break;
+    case MotionNotify:
+        // Deltas need the previous position, Platform fills them in
+        type = EventType::MOUSE_MOVE;
+        mouseEvent = { xevent->xmotion.x, xevent->xmotion.y, 0, 0, 
+            KeyEventType::PRESS, 0 };
+        break;
+    case ButtonPress:
+    case ButtonRelease: {
+        const XButtonEvent& button = xevent->xbutton;
+        mouseEvent = { button.x, button.y, 0, 0, 
+            xevent->type == ButtonPress ? KeyEventType::PRESS : KeyEventType::RELEASE, 
+            uint8_t(button.button) };
+
+        // The wheel comes as presses of buttons 4 to 7, each one a step.
+        // Their releases stay NONE, Platform drops them
+        if (button.button < 4 || button.button > 7) {
+            type = EventType::MOUSE_BUTTON;
+        } else if (xevent->type == ButtonPress) {
+            type = EventType::MOUSE_WHEEL;
+            mouseEvent.dy = button.button == 4 ? 1 : button.button == 5 ? -1 : 0;
+            mouseEvent.dx = button.button == 7 ? 1 : button.button == 6 ? -1 : 0;
+        }
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+#endif // __linux__
+
 void rpe::Platform::CreateWindow(
     int x, 
     int y, 
@@ -235,15 +4219,28 @@ void rpe::Platform::CreateWindow(
     unsigned int height,
     const char* title) {
 
+#ifdef __linux__
+    if (backend == Backend::HEADLESS) return;
+
+    if (threaded) XInitThreads();
+
     // Try open monitor
     d = XOpenDisplay(NULL);
 
-    // Halt if couldn't
+    // Halt if couldn't, unless any backend will do
     if(d == nullptr) {
+        if (backend == Backend::AUTO) {
+            printf("Can't connect X server, running headless.\n");
+            backend = Backend::HEADLESS;
+            return;
+        }
+
         printf("Can't connect X server.");
         std::exit(1);
     }
 
+    backend = Backend::X11;
+    pd = d;
     int screen = XDefaultScreen(d);
 
     w = XCreateSimpleWindow(
@@ -254,58 +4251,485 @@ void rpe::Platform::CreateWindow(
         // border with, border, background
         1, XBlackPixel(d, screen), XWhitePixel(d, screen));
 
-    XSelectInput(d, w, 
-    ExposureMask | KeyPressMask | KeyReleaseMask);
+    XSelectInput(d, w, eventMask);
     XStoreName(d, w, title);
 
     XAutoRepeatOff(d);
+
+    // The window exists on the server before the present thread's own
+    // connection starts drawing to it
+    XSync(d, False);
+
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+    backend = Backend::HEADLESS;
+#endif
+}
+
+void rpe::Platform::CreateGraphics(unsigned int width, unsigned int height, 
+    unsigned int scale) {
+    scale = std::max(scale, 1u);
+    // Already in place when the swap chain's present thread calls this
+    if (this->scale != scale) this->scale = scale;
+
+    // Headless frames never leave the engine framebuffer
+    if (backend == Backend::HEADLESS) return;
+
+    // The image has the window size, the framebuffer the logical one
+    width *= scale, height *= scale;
+
+#ifdef __linux__
+    int screen = XDefaultScreen(pd);
+    Visual* visual = XDefaultVisual(pd, screen);
+    unsigned int depth = XDefaultDepth(pd, screen);
+
+    gc = XCreateGC(pd, w, 0, nullptr);
+    if (gc == nullptr) {
+        printf("Can't create a graphics context.");
+        std::exit(1);
+    }
+    // Errors about the window or the GC reach the default handler here,
+    // instead of passing for a failed attach in the MIT-SHM check below
+    XSync(pd, False);
+
+    // MIT-SHM lets the server read the pixels straight from our memory,
+    // only available when the server runs on the same machine
+    useShm = XShmQueryExtension(pd);
+
+    if (useShm) {
+        image = XShmCreateImage(pd, visual, depth, ZPixmap, nullptr, 
+            &shmInfo, width, height);
+        // No image, no segment made for it yet either
+        if (image == nullptr) useShm = false;
+    }
+
+    if (image != nullptr) {
+        shmInfo.shmid = shmget(IPC_PRIVATE, 
+            size_t(image->bytes_per_line) * image->height, IPC_CREAT | 0600);
+        shmInfo.shmaddr = image->data = shmInfo.shmid < 0 ? 
+            (char*)-1 : (char*)shmat(shmInfo.shmid, nullptr, 0);
+        shmInfo.readOnly = False;
+
+        if (shmInfo.shmaddr != (char*)-1) {
+            // Attaching fails with BadAccess on remote connections
+            xErrorCaught = false;
+            auto oldHandler = XSetErrorHandler(TrapXErrors);
+            XShmAttach(pd, &shmInfo);
+            XSync(pd, False);
+            XSetErrorHandler(oldHandler);
+            useShm = !xErrorCaught;
+
+            if (!useShm) shmdt(shmInfo.shmaddr);
+        } else {
+            useShm = false;
+        }
+
+        // Marked for removal right away, freed once everyone detaches
+        if (shmInfo.shmid >= 0) shmctl(shmInfo.shmid, IPC_RMID, nullptr);
+
+        if (!useShm) {
+            image->data = nullptr;
+            XDestroyImage(image);
+            image = nullptr;
+        }
+    }
+
+    if (useShm) {
+        shmCompletionType = XShmGetEventBase(pd) + ShmCompletion;
+    } else {
+        // Plain XPutImage fallback, the pixels travel through the socket
+        image = XCreateImage(pd, visual, depth, ZPixmap, 0, nullptr, 
+            width, height, 32, 0);
+        if (image != nullptr) {
+            image->data = (char*)malloc(size_t(image->bytes_per_line) * height);
+        }
+        if (image == nullptr || image->data == nullptr) {
+            printf("Can't create a %ux%u image.", width, height);
+            std::exit(1);
+        }
+    }
+
+    // The server's pixel layout is looked at once, here. Present then 
+    // runs the conversion compiled for it
+    unsigned long r = image->red_mask, g = image->green_mask, b = image->blue_mask;
+    int bits = image->bits_per_pixel;
+    convertRow = nullptr;
+
+    if (image->byte_order == LSBFirst) {
+        if (bits == 32 && r == 0xff0000 && g == 0xff00 && b == 0xff) {
+            convertRow = ConvertToVisual<format::BGRA8888>;
+        } else if (bits == 32 && r == 0xff && g == 0xff00 && b == 0xff0000) {
+            convertRow = ConvertToVisual<format::RGBA8888>;
+        } else if (bits == 16 && r == 0xf800 && g == 0x07e0 && b == 0x001f) {
+            convertRow = ConvertToVisual<format::RGB565>;
+        }
+    }
+    nativeVisual = convertRow == ConvertToVisual<format::BGRA8888>;
+
+    if (convertRow == nullptr) {
+        printf("Unsupported X visual, %d bits per pixel, masks %lx %lx %lx.", 
+            bits, r, g, b);
+    }
+#endif
+}
+
+void rpe::Platform::DestroyGraphics() {
+#ifdef __linux__
+    if (image == nullptr) return;
+
+    if (useShm) {
+        XShmDetach(pd, &shmInfo);
+        XSync(pd, False);
+        shmdt(shmInfo.shmaddr);
+        image->data = nullptr;
+    }
+
+    XDestroyImage(image);
+    image = nullptr;
+    XFreeGC(pd, gc);
+#endif
+}
+
+void rpe::Platform::CreateSwapChain(unsigned int depth, 
+    const Framebuffer& framebuffer, unsigned int scale) {
+    unsigned int width = framebuffer.width, height = framebuffer.height;
+
+    // Set here as well, mouse events read it on this thread meanwhile
+    this->scale = scale = std::max(scale, 1u);
+
+    swapChain.Start(depth, framebuffer, [this, width, height, scale]() {
+        RPE_PROFILE_THREAD("present");
+    #ifdef __linux__
+        // Sharing `d` would do (threaded is set), but a connection of its
+        // own keeps the present thread out of the event thread's way
+        if (backend == Backend::X11) {
+            pd = XOpenDisplay(DisplayString(d));
+            if (pd == nullptr) pd = d;
+        }
+    #endif
+        CreateGraphics(width, height, scale);
+    }, [this](const Framebuffer& frame) {
+        Present(frame);
+    }, [this]() {
+        DestroyGraphics();
+    #ifdef __linux__
+        if (backend == Backend::X11 && pd != d) XCloseDisplay(pd);
+        pd = d;
+    #endif
+    });
+}
+
+void rpe::Platform::DestroySwapChain() {
+    swapChain.Stop();
 }
 
-void rpe::Platform::CreateGraphics() {
-    // TODO
+void rpe::Platform::Present(const Framebuffer& framebuffer) {
+    RPE_PROFILE_SCOPE("Present");
+    presentedFrames++;
+
+#ifdef __linux__
+    if (image == nullptr || convertRow == nullptr) return;
+
+    // The server may still be reading the segment from the previous frame
+    if (shmPending) {
+        XEvent completion;
+        XIfEvent(pd, &completion, [](Display*, XEvent* e, XPointer type) {
+            return Bool(e->type == *(int*)type);
+        }, (XPointer)&shmCompletionType);
+        shmPending = false;
+    }
+
+    int scale = int(this->scale);
+    int bytesPerPixel = image->bits_per_pixel / 8;
+    Rect screen = { 0, 0, image->width, image->height };
+    Rect bounds = Rect{ 0, 0, image->width / scale, image->height / scale }
+        .Intersect(framebuffer.Bounds());
+
+    // Only what changed travels to the image
+    const kernels::KernelTable& k = kernels::Kernels();
+    std::vector<Rect>& rects = presentRects;
+    rects.clear();
+    for (const Rect& damaged : framebuffer.DamagedRects()) {
+        Rect rect = damaged.Intersect(bounds);
+        if (rect.Empty()) continue;
+
+        size_t wide = size_t(rect.width) * scale;
+        size_t rowBytes = wide * bytesPerPixel;
+        for (int y = rect.y; y < rect.y + rect.height; y++) {
+            char* dst = image->data + size_t(y) * scale * image->bytes_per_line + 
+                size_t(rect.x) * scale * bytesPerPixel;
+
+            // Palette applied here and nowhere else
+            const uint32_t* src;
+            if (framebuffer.mode == PixelMode::RGBA32) {
+                src = framebuffer.Row(y) + rect.x;
+            } else {
+                if (scale == 1 && nativeVisual) {
+                    k.Expand8((uint32_t*)dst, framebuffer.IndexRow(y) + rect.x, 
+                        rect.width, framebuffer.Palette());
+                    continue;
+                }
+
+                presentRow.resize(rect.width);
+                k.Expand8(presentRow.data(), framebuffer.IndexRow(y) + rect.x, 
+                    rect.width, framebuffer.Palette());
+                src = presentRow.data();
+            }
+
+            // Widened once, the other rows of the square are copies of it
+            if (nativeVisual && scale == 1) {
+                memcpy(dst, src, rowBytes);
+            } else if (nativeVisual) {
+                k.Upscale32((uint32_t*)dst, src, rect.width, scale);
+            } else {
+                if (scale > 1) {
+                    presentWide.resize(wide);
+                    k.Upscale32(presentWide.data(), src, rect.width, scale);
+                    src = presentWide.data();
+                }
+                convertRow(dst, src, wide);
+            }
+
+            for (int j = 1; j < scale; j++) {
+                memcpy(dst + size_t(j) * image->bytes_per_line, dst, rowBytes);
+            }
+        }
+        rects.push_back({ rect.x * scale, rect.y * scale, 
+            rect.width * scale, rect.height * scale });
+    }
+
+    // Areas uncovered on the screen, the image still holds their pixels
+    {
+        std::lock_guard<std::mutex> guard(exposedMtx);
+        for (const Rect& rect : exposed) rects.push_back(rect.Intersect(screen));
+        exposed.clear();
+    }
+
+    rects.erase(std::remove_if(rects.begin(), rects.end(), 
+        [](const Rect& r) { return r.Empty(); }), rects.end());
+    if (rects.empty()) return;
+
+    for (size_t i = 0; i < rects.size(); i++) {
+        const Rect& r = rects[i];
+
+        if (useShm) {
+            // Requests are handled in order, so completion of the last
+            // one means the server is done with the whole segment.
+            // When threads share the connection the completion event could 
+            // be pulled out by PollEvents on the other one, a round trip 
+            // tells just the same
+            bool last = i + 1 == rects.size() && (!threaded || pd != d);
+            XShmPutImage(pd, w, gc, image, r.x, r.y, r.x, r.y, 
+                r.width, r.height, last);
+            shmPending = shmPending || last;
+        } else {
+            XPutImage(pd, w, gc, image, r.x, r.y, r.x, r.y, r.width, r.height);
+        }
+    }
+
+    if (useShm && threaded && pd == d) XSync(pd, False);
+
+    XFlush(pd);
+#endif
 }
 
 void rpe::Platform::ShowWindow() {
+#ifdef __linux__
+    if (backend == Backend::HEADLESS) return;
+
     XMapWindow(d, w);
     XFlush(d);
+#endif
 }
 
 void rpe::Platform::SetWindowTitle(const char* title) {
+#ifdef __linux__
+    if (backend == Backend::HEADLESS) return;
+
     XStoreName(d, w, title);
+#endif
 }
 
-void rpe::Platform::PollEvents(rpe::RapturePixelEngine* engine) {
-    XEvent tmp;
-    Event out;
-    
-    bool newEvent = XCheckWindowEvent(d, w, 
-    ExposureMask | KeyPressMask | KeyReleaseMask, 
-    &tmp);
+uint8_t rpe::Platform::KeyCode(unsigned long keysym) {
+#ifdef __linux__
+    if (backend == Backend::HEADLESS) return 0;
 
-    switch (tmp.type)
+    return uint8_t(XKeysymToKeycode(d, KeySym(keysym)));
+#else
+    return 0;
+#endif
+}
+
+void rpe::Platform::PushEvent(const Event& event) {
     {
-    case KeyPress:
-        out = Event(Event::EventType::KEY);
-        out.keyEvent.type = Event::KeyEventType::PRESS;
-        if(newEvent) engine->callbacks.OnKey(out);
-        break;
-    case KeyRelease:
-        out = Event(Event::EventType::KEY);
-        out.keyEvent.type = Event::KeyEventType::RELEASE;
-        
-        if(newEvent) engine->callbacks.OnKey(out);
-        break;
+        std::lock_guard<std::mutex> guard(syntheticMtx);
+        syntheticEvents.push_back(event);
+    }
+    Wake();
+}
 
-    default:
-        out = Event(Event::EventType::NONE);
-        break;
+bool rpe::Platform::WaitEvents(double timeout) {
+    std::unique_lock<std::mutex> guard(syntheticMtx);
+
+    if (backend == Backend::HEADLESS) {
+        auto ready = [this]() { return woken || !syntheticEvents.empty(); };
+
+        bool result = true;
+        if (timeout < 0.0) {
+            syntheticSignal.wait(guard, ready);
+        } else {
+            result = syntheticSignal.wait_for(guard, 
+                std::chrono::duration<double>(timeout), ready);
+        }
+
+        woken = false;
+        return result;
+    }
+
+    if (!syntheticEvents.empty()) return true;
+    guard.unlock();
+
+#ifdef __linux__
+    // Already buffered client-side, the socket would never wake us
+    if (XEventsQueued(d, QueuedAfterFlush) > 0) return true;
+
+    pollfd fds[2] = {
+        { ConnectionNumber(d), POLLIN, 0 },
+        { wakeFd, POLLIN, 0 },
+    };
+
+    int result = poll(fds, wakeFd < 0 ? 1 : 2, 
+        timeout < 0.0 ? -1 : int(timeout * 1000.0 + 0.5));
+
+    if (fds[1].revents & POLLIN) {
+        eventfd_t value;
+        eventfd_read(wakeFd, &value);
     }
-    
-    if(newEvent) engine->callbacks.OnEventCallback(out);
 
-    return;
+    return result > 0;
+#else
+    return false;
+#endif
+}
+
+void rpe::Platform::Wake() {
+    if (backend == Backend::HEADLESS) {
+        {
+            std::lock_guard<std::mutex> guard(syntheticMtx);
+            woken = true;
+        }
+        syntheticSignal.notify_all();
+        return;
+    }
+
+#ifdef __linux__
+    if (wakeFd >= 0) eventfd_write(wakeFd, 1);
+#endif
+}
+
+template <class Handler>
+unsigned int rpe::Platform::PollSyntheticEvents(
+    rpe::RapturePixelEngine* engine, Handler& handler, unsigned int cap) {
+
+    unsigned int handled = 0;
+
+    while (cap == 0 || handled < cap) {
+        Event event;
+        {
+            std::lock_guard<std::mutex> guard(syntheticMtx);
+            if (syntheticEvents.empty()) break;
+            event = syntheticEvents.front();
+            syntheticEvents.pop_front();
+        }
+
+        // Dispatched unlocked, callbacks may push more events
+        if (!discardInput) engine->DispatchEvent(handler, event);
+        handled++;
+    }
+
+    return handled;
+}
+
+void rpe::Platform::PollEvents(rpe::RapturePixelEngine* engine) {
+    PollEvents(engine, engine->dynamicHandler);
+}
+
+template <class Handler>
+void rpe::Platform::PollEvents(rpe::RapturePixelEngine* engine, Handler& handler) {
+    unsigned int cap = engine->config.batchEvents ? 
+        engine->config.maxEventsPerFrame : 1;
+    unsigned int handled = PollSyntheticEvents(engine, handler, cap);
+
+    if (backend == Backend::HEADLESS || (cap != 0 && handled >= cap)) return;
+
+#ifdef __linux__
+    XEvent tmp;
+
+    if (!engine->config.batchEvents) {
+        // Legacy mode, at most one event per frame
+        if (XCheckWindowEvent(d, w, eventMask, &tmp) && !IsWheelRelease(tmp)) {
+            if (tmp.type == Expose) QueueExposed(tmp.xexpose);
+            Event event(&tmp);
+            if (event.IsMouse()) ToFramebufferPixels(event);
+            if (!discardInput) engine->DispatchEvent(handler, event);
+        }
+        return;
+    }
+
+    // Batched mode, drain everything that is queued right now, bounded by
+    // the cap so a flood of events cannot starve rendering.
+    // Only the first query flushes and reads the socket, the rest of the
+    // batch is served from the client-side queue.
+    int queued = XEventsQueued(d, QueuedAfterFlush);
+
+    // Runs of motion become one MOUSE_MOVE, dispatched before whatever
+    // comes next so the order of events is kept. A pending motion holds
+    // on to its slot under the cap, so flushing it never goes past
+    Event motion;
+    auto reserved = [&]() {
+        return handled + (motion.type != Event::EventType::NONE);
+    };
+    auto flushMotion = [&]() {
+        if (motion.type == Event::EventType::NONE) return;
+        if (!discardInput) engine->DispatchEvent(handler, motion);
+        motion.type = Event::EventType::NONE;
+        handled++;
+    };
+
+    while ((cap == 0 || reserved() < cap) && 
+        (queued > 0 || (queued = XEventsQueued(d, QueuedAlready)) > 0)) {
+        XNextEvent(d, &tmp);
+        queued--;
+
+        // Not a window event, nothing to dispatch. With a swap chain the
+        // present thread waits for its own completions
+        if (tmp.type == shmCompletionType) {
+            if (!swapChain.Active()) shmPending = false;
+            continue;
+        }
+        if (IsWheelRelease(tmp)) continue;
+
+        if (tmp.type == Expose) QueueExposed(tmp.xexpose);
+
+        Event event(&tmp);
+        if (event.IsMouse()) ToFramebufferPixels(event);
+
+        if (event.type == Event::EventType::MOUSE_MOVE) {
+            if (motion.type != Event::EventType::NONE) {
+                event.mouseEvent.dx += motion.mouseEvent.dx;
+                event.mouseEvent.dy += motion.mouseEvent.dy;
+            }
+            motion = event;
+            continue;
+        }
+
+        flushMotion();
+        if (!discardInput) engine->DispatchEvent(handler, event);
+        handled++;
+    }
+    flushMotion();
+#endif
 }
-#endif // __linux__
 
 #pragma endregion // METHOD IMPLEMENTATIONS
 
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "RapturePixelEngine.hpp"
+
+// Timings of the engine's hot paths, printed to stdout as a single JSON
+// object so runs can be compared for regressions. Runs without an X
+// server (or under Xvfb for the presentation numbers).
+//
+//   ./RapturePixelEngineBenchmark [--headless] [--quick]
+
+using namespace rpe;
+using Clock = std::chrono::steady_clock;
+
+static double Seconds(Clock::time_point since) {
+    return std::chrono::duration<double>(Clock::now() - since).count();
+}
+
+/// Best time per call of `body` out of a few rounds, each one running for
+/// at least `minTime` seconds so short bodies get averaged
+template <class Fn>
+static double Measure(double minTime, Fn&& body) {
+    double best = 1e30;
+
+    for (int round = 0; round < 5; round++) {
+        uint64_t calls = 0;
+        auto start = Clock::now();
+        do {
+            body();
+            calls++;
+        } while (Seconds(start) < minTime);
+
+        best = std::min(best, Seconds(start) / calls);
+    }
+    return best;
+}
+
+/// Results in the order they were taken, values of NaN print as null
+static std::vector<std::pair<std::string, double>> results;
+
+static void Report(const char* name, double value) {
+    results.emplace_back(name, value);
+}
+
+/// Counts keys without going through std::function
+struct CountingHandler : EventHandler {
+    uint64_t keys = 0;
+    void OnKey(const Event&) { keys++; }
+};
+
+/// Pseudo random numbers, the same on every run
+static uint32_t Random() {
+    static uint32_t seed = 1;
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static void BenchDispatch(RapturePixelEngine* engine, double minTime) {
+    const int batch = 4096;
+    Platform* platform = engine->platform;
+    Event key(Event::EventType::KEY);
+    key.keyEvent = { Event::KeyEventType::PRESS, 38 };
+
+    // Only PollEvents is timed, filling the queue is not
+    auto perEvent = [&](auto&& poll) {
+        double best = 1e30;
+        auto start = Clock::now();
+        do {
+            for (int i = 0; i < batch; i++) platform->PushEvent(key);
+            auto polled = Clock::now();
+            poll();
+            best = std::min(best, Seconds(polled) / batch);
+        } while (Seconds(start) < minTime * 5);
+        return best * 1e9;
+    };
+
+    engine->config.maxEventsPerFrame = 0;
+
+    CountingHandler handler;
+    double direct = perEvent([&]() { platform->PollEvents(engine, handler); });
+
+    uint64_t keys = 0;
+    engine->callbacks.OnKey = [&](const Event&) { keys++; };
+    double callbacks = perEvent([&]() { platform->PollEvents(engine); });
+
+    Report("dispatch_handler_ns_per_event", direct);
+    Report("dispatch_callbacks_ns_per_event", callbacks);
+    Report("callback_overhead_ns_per_event", callbacks - direct);
+}
+
+static void BenchFill(double minTime) {
+    Framebuffer framebuffer;
+    framebuffer.Resize(1920, 1080);
+    double frameBytes = 1920.0 * 1080 * 4;
+
+    double clear = Measure(minTime, [&]() { framebuffer.Clear(Random()); });
+    Report("clear_1080p_gb_s", frameBytes / clear / 1e9);
+
+    double fill = Measure(minTime, [&]() {
+        framebuffer.FillRect(int(Random() % 1920) - 128, int(Random() % 1080) - 128, 256, 256, Random());
+        framebuffer.ClearDamage();
+    });
+    Report("fill_256_rects_per_s", 1.0 / fill);
+    Report("fill_256_gb_s", 256.0 * 256 * 4 / fill / 1e9);
+
+    framebuffer.Resize(1920, 1080, PixelMode::INDEXED8);
+    double indexed = Measure(minTime, [&]() { framebuffer.Clear(Random()); });
+    Report("clear_1080p_indexed_gb_s", 1920.0 * 1080 / indexed / 1e9);
+}
+
+static void BenchBlit(double minTime) {
+    Framebuffer framebuffer;
+    framebuffer.Resize(1920, 1080);
+
+    Sprite sprite(32, 32);
+    for (unsigned int y = 0; y < 32; y++) {
+        for (unsigned int x = 0; x < 32; x++) {
+            uint32_t a = (x + y) % 3 ? 0x80 : 0xff;
+            sprite.SetPixel(x, y, (x + y) % 5 ? Rgba(x * 8, y * 8, 128, a) : sprite.colorKey);
+        }
+    }
+    sprite.Premultiply();
+
+    const struct { BlitMode mode; const char* sprites; const char* bytes; } modes[] = {
+        { BlitMode::OPAQUE, "blit_opaque_32_sprites_per_s", "blit_opaque_gb_s" },
+        { BlitMode::COLOR_KEY, "blit_color_key_32_sprites_per_s", "blit_color_key_gb_s" },
+        { BlitMode::ALPHA, "blit_alpha_32_sprites_per_s", "blit_alpha_gb_s" },
+    };
+
+    const int batch = 1000;
+    for (const auto& mode : modes) {
+        double time = Measure(minTime, [&]() {
+            for (int i = 0; i < batch; i++) {
+                framebuffer.Blit(sprite, int(Random() % 1920) - 16, int(Random() % 1080) - 16, mode.mode);
+            }
+            framebuffer.ClearDamage();
+        }) / batch;
+
+        Report(mode.sprites, 1.0 / time);
+        Report(mode.bytes, 32.0 * 32 * 4 / time / 1e9);
+    }
+
+    // The same through a command list, binned and drawn by the jobs
+    JobSystem jobs;
+    jobs.Start();
+    TileRasterizer rasterizer;
+    CommandList commands;
+
+    const int sprites = 20000;
+    double time = Measure(minTime, [&]() {
+        commands.Reset();
+        for (int i = 0; i < sprites; i++) {
+            commands.Blit(sprite, int(Random() % 1920) - 16, int(Random() % 1080) - 16, BlitMode::ALPHA);
+        }
+        rasterizer.Execute(commands, framebuffer, jobs);
+        framebuffer.ClearDamage();
+    }) / sprites;
+
+    Report("tiled_alpha_32_sprites_per_s", 1.0 / time);
+}
+
+static void BenchPrimitives(double minTime) {
+    Framebuffer framebuffer;
+    framebuffer.Resize(1920, 1080);
+
+    // Debug overlay sized shapes, up to 64 pixels across
+    const int batch = 1000;
+    auto perSecond = [&](auto&& draw) {
+        double time = Measure(minTime, [&]() {
+            for (int i = 0; i < batch; i++) {
+                draw(int(Random() % 1920), int(Random() % 1080), int(Random() % 64), 
+                    int(Random() % 64), Random() | 0xff000000);
+            }
+            framebuffer.ClearDamage();
+        }) / batch;
+        return 1.0 / time;
+    };
+
+    Report("lines_64_per_s", perSecond([&](int x, int y, int w, int h, uint32_t color) {
+        framebuffer.DrawLine(x, y, x + w - 32, y + h - 32, color);
+    }));
+    Report("lines_aa_64_per_s", perSecond([&](int x, int y, int w, int h, uint32_t color) {
+        framebuffer.DrawLineAA(float(x), float(y), x + w - 31.5f, y + h - 31.5f, color);
+    }));
+    Report("circles_64_per_s", perSecond([&](int x, int y, int w, int, uint32_t color) {
+        framebuffer.DrawCircle(x, y, w / 2, color);
+    }));
+    Report("filled_circles_64_per_s", perSecond([&](int x, int y, int w, int, uint32_t color) {
+        framebuffer.FillCircle(x, y, w / 2, color);
+    }));
+    Report("polygons_64_per_s", perSecond([&](int x, int y, int w, int h, uint32_t color) {
+        Point star[] = { { x, y - h / 2 }, { x + w / 4, y + h / 2 }, { x - w / 2, y - h / 8 }, 
+            { x + w / 2, y - h / 8 }, { x - w / 4, y + h / 2 } };
+        framebuffer.FillPolygon(star, 5, color);
+    }));
+}
+
+static void BenchPresentKernels(double minTime) {
+    const kernels::KernelTable& k = kernels::Kernels();
+    std::vector<uint8_t> indices(1920);
+    std::vector<uint32_t> palette(256), pixels(1920), row(1920 * 4);
+    for (size_t i = 0; i < indices.size(); i++) indices[i] = uint8_t(Random());
+
+    double expand = Measure(minTime, [&]() {
+        k.Expand8(row.data(), indices.data(), indices.size(), palette.data());
+    });
+    Report("expand8_gpixels_s", indices.size() / expand / 1e9);
+
+    // Output pixels per second, a 1080p row widened
+    for (unsigned int factor : { 2u, 3u, 4u }) {
+        double upscale = Measure(minTime, [&]() {
+            k.Upscale32(row.data(), pixels.data(), pixels.size(), factor);
+        });
+        std::string name = "upscale" + std::to_string(factor) + "x_gpixels_s";
+        Report(name.c_str(), pixels.size() * factor / upscale / 1e9);
+    }
+}
+
+static void BenchPresent(RapturePixelEngine* engine, bool headless, double minTime) {
+    Platform* platform = engine->platform;
+    platform->backend = headless ? Backend::HEADLESS : Backend::AUTO;
+    platform->CreateWindow(0, 0, 1280, 720, "RapturePixelEngine Benchmark");
+
+    if (platform->backend == Backend::HEADLESS) {
+        Report("present_full_720p_ms", NAN);
+        Report("present_64_rect_ms", NAN);
+        return;
+    }
+
+    Framebuffer framebuffer;
+    framebuffer.Resize(1280, 720);
+    platform->CreateGraphics(1280, 720);
+    platform->ShowWindow();
+
+    // Each Present waits for the server to be done with the previous one,
+    // so this is the time a frame spends in presentation
+    double full = Measure(minTime, [&]() {
+        framebuffer.Clear(Random());
+        platform->Present(framebuffer);
+        framebuffer.ClearDamage();
+    });
+    double small = Measure(minTime, [&]() {
+        framebuffer.FillRect(Random() % 1216, Random() % 656, 64, 64, Random());
+        platform->Present(framebuffer);
+        framebuffer.ClearDamage();
+    });
+
+    Report("present_full_720p_ms", full * 1e3);
+    Report("present_64_rect_ms", small * 1e3);
+    platform->DestroyGraphics();
+}
+
+int main(int argc, char *argv[]) {
+    bool headless = false;
+    double minTime = 0.05;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) headless = true;
+        if (strcmp(argv[i], "--quick") == 0) minTime = 0.005;
+    }
+
+    // Numbers of a broken kernel are worthless, check them first
+    const kernels::KernelTable* failed = nullptr;
+    if (!kernels::VerifyKernels(&failed)) {
+        fprintf(stderr, "%s kernels differ from the scalar reference.\n", failed->name);
+        return 1;
+    }
+
+    RapturePtr engine = RapturePixelEngine::instance();
+
+    // Synthetic events only, no window needed
+    engine->platform->backend = Backend::HEADLESS;
+    BenchDispatch(engine, minTime);
+    BenchFill(minTime);
+    BenchBlit(minTime);
+    BenchPrimitives(minTime);
+    BenchPresentKernels(minTime);
+    BenchPresent(engine, headless, minTime);
+
+    printf("{\n    \"simd\": \"%s\",\n    \"backend\": \"%s\"", kernels::Kernels().name,
+        engine->platform->backend == Backend::X11 ? "x11" : "headless");
+
+    // Kernel tables VerifyKernels() checked against the scalar ones
+    printf(",\n    \"verified_simd\": [");
+    const char* separator = "";
+    for (kernels::SimdLevel level : { kernels::SimdLevel::SSE2, kernels::SimdLevel::AVX2, 
+        kernels::SimdLevel::AVX512, kernels::SimdLevel::NEON }) {
+        if (const kernels::KernelTable* table = kernels::KernelsFor(level)) {
+            printf("%s\"%s\"", separator, table->name);
+            separator = ", ";
+        }
+    }
+    printf("]");
+    for (const auto& result : results) {
+        if (std::isnan(result.second)) {
+            printf(",\n    \"%s\": null", result.first.c_str());
+        } else {
+            printf(",\n    \"%s\": %.4g", result.first.c_str(), result.second);
+        }
+    }
+    printf("\n}\n");
+
+    return 0;
+}
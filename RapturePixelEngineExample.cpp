@@ -9,12 +9,19 @@ int main(int argc, char *argv[]) {
     // Retrieve the engine instance
     RapturePtr engine = RapturePixelEngine::instance();
 
+    // Paint the background once the window is up
+    engine->callbacks.OnBegin = [&]() {
+        engine->framebuffer.Clear(Rgba(32, 32, 48));
+    };
+
     // Register a callback for general event
     engine->callbacks.OnKey = [&](const Event& e) {
         if(e.keyEvent.type == Event::KeyEventType::PRESS) {
             engine->SetWindowTitle("Pressed"); 
+            engine->framebuffer.FillRect(96, 96, 64, 64, Rgba(255, 128, 0));
         } else if (e.keyEvent.type == Event::KeyEventType::RELEASE) {
             engine->SetWindowTitle("Released");
+            engine->framebuffer.FillRect(96, 96, 64, 64, Rgba(32, 32, 48));
         }
     };
 